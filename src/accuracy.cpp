@@ -0,0 +1,318 @@
+#include "include/benchCommon.h"
+#include "include/celestialBody.h"
+#include "include/gravityEngine.h"
+#include "include/parallel.h"
+#include "include/sceneGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define ACCURACY_GRAVITATIONAL_CONSTANT 0.1f
+
+struct AccuracyConfig {
+  std::vector<size_t> counts{10000};
+  std::vector<float> thetas{0.3f, 0.5f, 0.7f, 1.0f};
+  std::vector<OpeningCriterion> criteria{OpeningCriterion::Geometric};
+  // Relative only
+  std::vector<float> forceAccuracies{BARNES_HUT_FORCE_ACCURACY};
+  std::vector<int> expansionOrders{0, 2};
+  std::vector<int> leafCapacities{1, 8, 16};
+  int threadCount = hardwareThreadCount();
+  std::vector<PrecisionMode> precisions{PrecisionMode::Float};
+  SceneType scene = SceneType::Disc;
+  unsigned int seed = 42;
+  PlanarMode planarMode = PlanarMode::Auto;
+  std::string outputPath;
+};
+
+struct AccuracyResult {
+  std::string precision;
+  size_t count;
+  std::string criterion;
+  float theta;
+  // 0 unless criterion is relative
+  float forceAccuracy;
+  int expansionOrder;
+  int leafCapacity;
+  double medianError;
+  double p99Error;
+  double maxError;
+  double interactionsPerBody;
+  double forceMs;
+  double directForceMs;
+};
+
+static void printUsage() {
+  std::cerr
+      << "usage: gravity_accuracy [options]\n"
+         "  --n LIST          body counts\n"
+         "  --theta LIST      Barnes-Hut opening angles\n"
+         "  --criterion LIST  geometric,bmax,relative opening criteria\n"
+         "  --accuracy LIST   force accuracies of the relative criterion\n"
+         "  --order LIST      expansion orders (0 monopole, 2 quadrupole)\n"
+         "  --leaf LIST       octree leaf capacities\n"
+         "  --threads N       worker threads for both engines\n"
+         "  --precision LIST  float,double,mixed Barnes-Hut engines\n"
+         "  --scene NAME      disc | flat-disc | plummer\n"
+         "  --seed N          scene seed\n"
+         "  --planar MODE     auto | off | on, Barnes-Hut planar quadtree\n"
+         "  --output FILE     write JSON to FILE instead of stdout\n";
+}
+
+static bool parseCriterionList(const std::string &text,
+                               std::vector<OpeningCriterion> &criteria) {
+  std::vector<std::string> names;
+  if (!parseList(text, names))
+    return false;
+  criteria.clear();
+  for (const std::string &name : names) {
+    OpeningCriterion criterion;
+    if (!parseOpeningCriterion(name, criterion))
+      return false;
+    criteria.push_back(criterion);
+  }
+  return true;
+}
+
+static bool parseArguments(int argc, char **argv, AccuracyConfig &config) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+      return false;
+    if (i + 1 >= argc) {
+      std::cerr << "missing value for " << arg << "\n";
+      return false;
+    }
+    std::string value = argv[++i];
+
+    bool ok = true;
+    try {
+      if (arg == "--n")
+        ok = parseList(value, config.counts);
+      else if (arg == "--theta")
+        ok = parseList(value, config.thetas);
+      else if (arg == "--criterion")
+        ok = parseCriterionList(value, config.criteria);
+      else if (arg == "--accuracy")
+        ok = parseList(value, config.forceAccuracies);
+      else if (arg == "--order")
+        ok = parseList(value, config.expansionOrders);
+      else if (arg == "--leaf")
+        ok = parseList(value, config.leafCapacities);
+      else if (arg == "--threads")
+        config.threadCount = std::max(1, std::stoi(value));
+      else if (arg == "--precision")
+        ok = parsePrecisionList(value, config.precisions);
+      else if (arg == "--scene")
+        ok = parseSceneType(value, config.scene);
+      else if (arg == "--seed")
+        config.seed = std::stoul(value);
+      else if (arg == "--planar")
+        ok = parsePlanarMode(value, config.planarMode);
+      else if (arg == "--output")
+        config.outputPath = value;
+      else {
+        std::cerr << "unknown option " << arg << "\n";
+        return false;
+      }
+    } catch (const std::exception &) {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "invalid value for " << arg << ": " << value << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename P>
+static double timeAccelerations(BasicGravityEngine<P> &engine,
+                                std::vector<BasicCelestialBody<P>> &bodies) {
+  auto start = std::chrono::steady_clock::now();
+  engine.computeAccelerations(bodies, ACCURACY_GRAVITATIONAL_CONSTANT);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static void writeJson(std::ostream &out, const AccuracyConfig &config,
+                      const std::vector<AccuracyResult> &results) {
+  out << "{\n";
+  out << "  \"benchmark\": \"gravity_accuracy\",\n";
+  out << "  \"scene\": \"" << sceneTypeName(config.scene) << "\",\n";
+  out << "  \"seed\": " << config.seed << ",\n";
+  out << "  \"threads\": " << config.threadCount << ",\n";
+  out << "  \"planar\": \"" << planarModeName(config.planarMode) << "\",\n";
+  out << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const AccuracyResult &r = results[i];
+    out << (i == 0 ? "\n" : ",\n");
+    out << "    {\"precision\": \"" << r.precision << "\", \"n\": " << r.count
+        << ", \"criterion\": \"" << r.criterion << "\""
+        << ", \"theta\": " << r.theta
+        << ", \"forceAccuracy\": " << r.forceAccuracy
+        << ", \"expansionOrder\": " << r.expansionOrder
+        << ", \"leafCapacity\": " << r.leafCapacity
+        << ", \"medianRelativeError\": " << r.medianError
+        << ", \"p99RelativeError\": " << r.p99Error
+        << ", \"maxRelativeError\": " << r.maxError
+        << ", \"interactionsPerBody\": " << r.interactionsPerBody
+        << ", \"forceMs\": " << r.forceMs
+        << ", \"directForceMs\": " << r.directForceMs << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+// one Barnes-Hut configuration against the reference
+template <typename P>
+static AccuracyResult
+measureBarnesHut(BasicBarnesHutEngine<P> &engine,
+                 std::vector<BasicCelestialBody<P>> &bodies,
+                 const std::vector<glm::dvec3> &reference) {
+  // the relative criterion needs last step's accelerations; the bodies stay
+  // put, so a first pass stands in for them
+  if (engine.openingCriterion == OpeningCriterion::Relative)
+    timeAccelerations(engine, bodies);
+
+  AccuracyResult result;
+  result.forceMs = timeAccelerations(engine, bodies);
+  result.count = bodies.size();
+  result.criterion = openingCriterionName(engine.openingCriterion);
+  result.theta = engine.theta;
+  result.forceAccuracy =
+      engine.openingCriterion == OpeningCriterion::Relative
+          ? engine.forceAccuracy
+          : 0.0f;
+  result.expansionOrder = engine.expansionOrder;
+  result.leafCapacity = engine.leafCapacity;
+
+  std::vector<double> errors;
+  errors.reserve(bodies.size());
+  for (size_t i = 0; i < bodies.size(); i++) {
+    double referenceLength = glm::length(reference[i]);
+    if (bodies[i].isFixed() || referenceLength == 0.0)
+      continue;
+    errors.push_back(
+        glm::length(glm::dvec3(bodies[i].acceleration) - reference[i]) /
+        referenceLength);
+  }
+  result.medianError = percentile(errors, 0.5);
+  result.p99Error = percentile(errors, 0.99);
+  result.maxError = percentile(errors, 1.0);
+  result.interactionsPerBody =
+      errors.empty()
+          ? 0.0
+          : (double)engine.lastCounters.interactions() / errors.size();
+  return result;
+}
+
+// every Barnes-Hut configuration at one precision against the reference
+template <typename P>
+static void sweepBarnesHut(const AccuracyConfig &config,
+                           const std::vector<CelestialBody> &scene,
+                           const std::vector<glm::dvec3> &reference,
+                           double directMs, const char *precision,
+                           std::vector<AccuracyResult> &results) {
+  std::vector<BasicCelestialBody<P>> bodies(scene.begin(), scene.end());
+
+  // only the relative criterion has a force accuracy to sweep
+  std::vector<std::pair<OpeningCriterion, float>> openings;
+  for (OpeningCriterion criterion : config.criteria) {
+    if (criterion != OpeningCriterion::Relative)
+      openings.push_back({criterion, BARNES_HUT_FORCE_ACCURACY});
+    else
+      for (float forceAccuracy : config.forceAccuracies)
+        openings.push_back({criterion, forceAccuracy});
+  }
+
+  for (const auto &opening : openings) {
+    for (float theta : config.thetas) {
+      for (int expansionOrder : config.expansionOrders) {
+        for (int leafCapacity : config.leafCapacities) {
+          BasicBarnesHutEngine<P> engine(theta, leafCapacity, expansionOrder);
+          engine.threadCount = config.threadCount;
+          engine.planarMode = config.planarMode;
+          engine.openingCriterion = opening.first;
+          engine.forceAccuracy = opening.second;
+          std::cerr << "barnes-hut " << precision << " n=" << bodies.size()
+                    << " criterion=" << openingCriterionName(opening.first)
+                    << " theta=" << theta;
+          if (opening.first == OpeningCriterion::Relative)
+            std::cerr << " accuracy=" << opening.second;
+          std::cerr << " order=" << expansionOrder
+                    << " leaf=" << leafCapacity << "\n";
+
+          AccuracyResult result = measureBarnesHut(engine, bodies, reference);
+          result.precision = precision;
+          result.directForceMs = directMs;
+          results.push_back(result);
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  AccuracyConfig config;
+  if (!parseArguments(argc, argv, config)) {
+    printUsage();
+    return 1;
+  }
+
+  std::vector<AccuracyResult> results;
+  std::vector<CelestialBody> scene;
+
+  for (size_t count : config.counts) {
+    generateScene(scene, config.scene, count, config.seed,
+                  ACCURACY_GRAVITATIONAL_CONSTANT);
+
+    // the reference is a double precision direct sum, so the float and
+    // mixed engines are measured against something better than themselves
+    std::vector<BasicCelestialBody<DoublePrecision>> referenceBodies(
+        scene.begin(), scene.end());
+    BasicDirectEngine<DoublePrecision> direct;
+    direct.threadCount = config.threadCount;
+    std::cerr << "direct reference n=" << count << "\n";
+    double directMs = timeAccelerations(direct, referenceBodies);
+
+    std::vector<glm::dvec3> reference(referenceBodies.size());
+    for (size_t i = 0; i < referenceBodies.size(); i++)
+      reference[i] = referenceBodies[i].acceleration;
+
+    for (PrecisionMode mode : config.precisions) {
+      const char *name = precisionModeName(mode);
+      switch (mode) {
+      case PrecisionMode::Float:
+        sweepBarnesHut<FloatPrecision>(config, scene, reference, directMs,
+                                       name, results);
+        break;
+      case PrecisionMode::Double:
+        sweepBarnesHut<DoublePrecision>(config, scene, reference, directMs,
+                                        name, results);
+        break;
+      case PrecisionMode::Mixed:
+        sweepBarnesHut<MixedPrecision>(config, scene, reference, directMs,
+                                       name, results);
+        break;
+      }
+    }
+  }
+
+  if (config.outputPath.empty()) {
+    writeJson(std::cout, config, results);
+  } else {
+    std::ofstream out(config.outputPath);
+    if (!out) {
+      std::cerr << "failed to open " << config.outputPath << "\n";
+      return 1;
+    }
+    writeJson(out, config, results);
+  }
+  return 0;
+}
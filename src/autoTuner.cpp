@@ -0,0 +1,291 @@
+#include "include/autoTuner.h"
+#include "include/cpuFeatures.h"
+#include "include/engineSelector.h"
+#include "include/parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+void TuningProfile::applyTo(BarnesHutEngine &engine) const {
+  engine.theta = theta;
+  engine.leafCapacity = leafCapacity;
+  engine.expansionOrder = expansionOrder;
+  engine.maxDepth = maxDepth;
+  engine.minSize = minSize;
+  engine.threadCount = threadCount;
+}
+
+// double direct-sum accelerations of an evenly strided sample of the
+// moving bodies
+struct TuningReference {
+  std::vector<size_t> sample;
+  std::vector<glm::dvec3> accelerations;
+};
+
+struct TuningRun {
+  double stepMs;
+  double p99Error;
+};
+
+static TuningReference directReference(const std::vector<CelestialBody> &bodies,
+                                       float G) {
+  TuningReference reference;
+  std::vector<size_t> moving;
+  for (size_t i = 0; i < bodies.size(); i++) {
+    if (bodies[i].isActive() && !bodies[i].isFixed())
+      moving.push_back(i);
+  }
+  size_t count = std::min(moving.size(), (size_t)AUTOTUNE_SAMPLE_COUNT);
+  for (size_t k = 0; k < count; k++)
+    reference.sample.push_back(moving[k * moving.size() / count]);
+
+  std::vector<BasicCelestialBody<DoublePrecision>> exact(bodies.begin(),
+                                                         bodies.end());
+  reference.accelerations.resize(count);
+  parallelFor(0, count, hardwareThreadCount(),
+              [&](size_t begin, size_t end, int) {
+                for (size_t k = begin; k < end; k++) {
+                  size_t i = reference.sample[k];
+                  glm::dvec3 sum(0.0);
+                  for (size_t j = 0; j < exact.size(); j++) {
+                    if (j != i && exact[j].isActive())
+                      sum += exact[i].gravityFrom(exact[j], G);
+                  }
+                  reference.accelerations[k] = sum;
+                }
+              });
+  return reference;
+}
+
+static TuningRun measure(const TuningProfile &profile,
+                         std::vector<CelestialBody> &bodies, float G,
+                         const TuningReference &reference) {
+  BarnesHutEngine engine;
+  profile.applyTo(engine);
+  // the first step only fills the cost zones
+  engine.computeAccelerations(bodies, G);
+
+  TuningRun run;
+  run.stepMs = std::numeric_limits<double>::max();
+  for (int repeat = 0; repeat < AUTOTUNE_REPEATS; repeat++) {
+    auto start = std::chrono::steady_clock::now();
+    engine.computeAccelerations(bodies, G);
+    auto end = std::chrono::steady_clock::now();
+    run.stepMs = std::min(
+        run.stepMs,
+        std::chrono::duration<double, std::milli>(end - start).count());
+  }
+
+  std::vector<double> errors;
+  for (size_t k = 0; k < reference.sample.size(); k++) {
+    double exact = glm::length(reference.accelerations[k]);
+    if (exact <= 0.0)
+      continue;
+    glm::dvec3 approximate(bodies[reference.sample[k]].acceleration);
+    errors.push_back(
+        glm::length(approximate - reference.accelerations[k]) / exact);
+  }
+  run.p99Error = 0.0;
+  if (!errors.empty()) {
+    auto p99 = errors.begin() + (size_t)(0.99 * (errors.size() - 1));
+    std::nth_element(errors.begin(), p99, errors.end());
+    run.p99Error = *p99;
+  }
+  return run;
+}
+
+TuningProfile autoTune(const std::vector<CelestialBody> &bodies, float G,
+                       const AutoTuneOptions &options) {
+  std::vector<CelestialBody> work(bodies);
+  TuningReference reference = directReference(work, G);
+
+  std::vector<int> threadCounts = options.threadCounts;
+  if (threadCounts.empty()) {
+    for (int threads = 1; threads < hardwareThreadCount(); threads *= 2)
+      threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreadCount());
+  }
+  int maxThreads = *std::max_element(threadCounts.begin(), threadCounts.end());
+
+  std::vector<float> thetas = options.thetas;
+  std::sort(thetas.begin(), thetas.end());
+
+  TuningProfile best;
+  bool found = false;
+  auto consider = [&](const TuningProfile &candidate) {
+    TuningRun run = measure(candidate, work, G, reference);
+    if (run.p99Error > options.maxError)
+      return false;
+    if (!found || run.stepMs < best.stepMs) {
+      best = candidate;
+      best.stepMs = run.stepMs;
+      best.p99Error = run.p99Error;
+      found = true;
+    }
+    return true;
+  };
+
+  // the error grows with theta, so the largest passing one is the cheapest
+  std::vector<TuningProfile> accurate;
+  for (int expansionOrder : options.expansionOrders) {
+    TuningProfile candidate;
+    candidate.expansionOrder = expansionOrder;
+    candidate.threadCount = maxThreads;
+    bool passed = false;
+    for (float theta : thetas) {
+      TuningProfile next = candidate;
+      next.theta = theta;
+      if (!consider(next))
+        break;
+      candidate = next;
+      passed = true;
+    }
+    if (passed)
+      accurate.push_back(candidate);
+  }
+
+  for (const TuningProfile &base : accurate) {
+    for (int leafCapacity : options.leafCapacities) {
+      for (int maxDepth : options.maxDepths) {
+        TuningProfile candidate = base;
+        candidate.leafCapacity = leafCapacity;
+        candidate.maxDepth = maxDepth;
+        consider(candidate);
+      }
+    }
+  }
+
+  if (!found) {
+    // nothing meets the bound: the most accurate candidate, flagged by its
+    // measured error
+    best.theta = thetas.front();
+    best.expansionOrder = *std::max_element(options.expansionOrders.begin(),
+                                            options.expansionOrders.end());
+    best.threadCount = maxThreads;
+    TuningRun run = measure(best, work, G, reference);
+    best.stepMs = run.stepMs;
+    best.p99Error = run.p99Error;
+  } else {
+    TuningProfile tuned = best;
+    for (int threads : threadCounts) {
+      TuningProfile candidate = tuned;
+      candidate.threadCount = threads;
+      consider(candidate);
+    }
+  }
+
+  // lets the engine selector compare against the direct sum without
+  // calibrating
+  best.directStepMs = estimateDirectStepMs(work, G, best.threadCount);
+  return best;
+}
+
+TuningCache::TuningCache(const std::string &path) : path(path) {}
+
+std::string TuningCache::defaultPath() {
+  const char *path = std::getenv(TUNING_CACHE_ENV);
+  if (path != nullptr && *path != '\0')
+    return path;
+  const char *cacheHome = std::getenv("XDG_CACHE_HOME");
+  if (cacheHome != nullptr && *cacheHome != '\0')
+    return std::string(cacheHome) + "/" + TUNING_CACHE_FILE;
+  const char *home = std::getenv("HOME");
+  if (home != nullptr && *home != '\0')
+    return std::string(home) + "/.cache/" + TUNING_CACHE_FILE;
+  return "gravity_tuning.txt";
+}
+
+std::string TuningCache::machineKey() {
+  std::string host = "localhost";
+#if defined(__unix__) || defined(__APPLE__)
+  char name[256];
+  if (gethostname(name, sizeof(name)) == 0) {
+    name[sizeof(name) - 1] = '\0';
+    host = name;
+  }
+#endif
+  std::ostringstream key;
+  key << host << "/" << hardwareThreadCount() << "t/"
+      << isaLevelName(detectedIsaLevel());
+  return key.str();
+}
+
+// body counts within a factor of sqrt(2) share a profile
+static int sizeBucket(size_t bodyCount) {
+  return (int)std::lround(std::log2((double)std::max<size_t>(bodyCount, 1)));
+}
+
+bool TuningCache::load() {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    std::string machine;
+    int bucket;
+    TuningProfile profile;
+    if (fields >> machine >> bucket >> profile.theta >> profile.leafCapacity >>
+        profile.expansionOrder >> profile.maxDepth >> profile.minSize >>
+        profile.threadCount >> profile.stepMs >> profile.p99Error) {
+      // older caches end before this column and keep the default
+      fields >> profile.directStepMs;
+      profiles[{machine, bucket}] = profile;
+    }
+  }
+  return true;
+}
+
+// written beside the cache and renamed over it, so a reader never sees a
+// half-written file
+bool TuningCache::save() const {
+  std::error_code error;
+  std::filesystem::path parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty())
+    std::filesystem::create_directories(parent, error);
+
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary);
+    if (!out)
+      return false;
+    out << "# machine log2(n) theta leaf order maxDepth minSize threads "
+           "stepMs p99Error directStepMs\n";
+    for (const auto &entry : profiles) {
+      const TuningProfile &profile = entry.second;
+      out << entry.first.first << " " << entry.first.second << " "
+          << profile.theta << " " << profile.leafCapacity << " "
+          << profile.expansionOrder << " " << profile.maxDepth << " "
+          << profile.minSize << " " << profile.threadCount << " "
+          << profile.stepMs << " " << profile.p99Error << " "
+          << profile.directStepMs << "\n";
+    }
+    if (!out)
+      return false;
+  }
+  return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool TuningCache::find(size_t bodyCount, TuningProfile &profile) const {
+  auto entry = profiles.find({machineKey(), sizeBucket(bodyCount)});
+  if (entry == profiles.end())
+    return false;
+  profile = entry->second;
+  return true;
+}
+
+void TuningCache::store(size_t bodyCount, const TuningProfile &profile) {
+  profiles[{machineKey(), sizeBucket(bodyCount)}] = profile;
+}
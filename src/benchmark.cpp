@@ -0,0 +1,737 @@
+#include "include/autoTuner.h"
+#include "include/benchCommon.h"
+#include "include/celestialBody.h"
+#include "include/cpuFeatures.h"
+#include "include/fixedPoint.h"
+#include "include/conservationMonitor.h"
+#include "include/engineSelector.h"
+#include "include/gravityEngine.h"
+#include "include/parallel.h"
+#include "include/profiler.h"
+#include "include/sceneGenerator.h"
+#include "include/spatialSort.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BENCH_GRAVITATIONAL_CONSTANT 0.1f
+#define BENCH_TIME_STEP 0.01f
+
+struct BenchConfig {
+  std::vector<size_t> counts{1000, 10000, 100000};
+  std::vector<std::string> engines{"direct", "barnes-hut"};
+  std::vector<float> thetas{BARNES_HUT_THETA};
+  std::vector<int> leafCapacities{OCTREE_LEAF_CAPACITY};
+  std::vector<int> expansionOrders{BARNES_HUT_EXPANSION_ORDER};
+  int maxDepth = OCTREE_MAX_DEPTH;
+  float minSize = OCTREE_MIN_SIZE;
+  std::vector<int> threadCounts{1, hardwareThreadCount()};
+  std::vector<PrecisionMode> precisions{PrecisionMode::Float};
+  SceneType scene = SceneType::Disc;
+  unsigned int seed = 42;
+  int steps = 10;
+  int warmupSteps = 2;
+  size_t directMaxCount = 50000;
+  std::string outputPath;
+  std::string tracePath;
+  bool checkDeterminism = false;
+  bool fixedPoint = false;
+  int reorderInterval = 0;
+  // measure energy and momentum drift every this many steps, 0 off
+  int conservationInterval = 0;
+  PlanarMode planarMode = PlanarMode::Auto;
+  std::vector<NodeLayout> nodeLayouts{BARNES_HUT_NODE_LAYOUT};
+  IsaLevel isaLevel = detectedIsaLevel();
+  // Barnes-Hut runs use the cached tuning profile for each count instead
+  // of the parameter lists, tuning on a miss or always with retune
+  bool autotune = false;
+  bool retune = false;
+};
+
+struct BenchResult {
+  std::string engine;
+  std::string precision;
+  size_t count;
+  float theta;
+  int leafCapacity;
+  int expansionOrder;
+  int maxDepth;
+  float minSize;
+  // Barnes-Hut only
+  std::string nodeLayout;
+  int threadCount;
+  double medianMs;
+  double p95Ms;
+  double meanMs;
+  double interactionsPerStep;
+  double interactionsPerSecond;
+  double bytesPerBody;
+  double bodyBodyPerStep;
+  double bodyCellPerStep;
+  double nodesOpenedPerStep;
+  // largest relative drifts, when the conservation monitor ran
+  bool conservation = false;
+  ConservationDrift drift;
+  OctreeStats tree;
+};
+
+static void printUsage() {
+  std::cerr
+      << "usage: gravity_bench [options]\n"
+         "  --n LIST          body counts, e.g. 1000,10000,1000000\n"
+         "  --engines LIST    direct,barnes-hut,auto (the cheaper of the two\n"
+         "                    for each scene)\n"
+         "  --theta LIST      Barnes-Hut opening angles\n"
+         "  --leaf LIST       octree leaf capacities\n"
+         "  --order LIST      expansion orders (0 monopole, 2 quadrupole)\n"
+         "  --max-depth N     octree depth limit\n"
+         "  --min-size X      smallest octree node edge\n"
+         "  --threads LIST    worker thread counts\n"
+         "  --precision LIST  float,double,mixed\n"
+         "  --scene NAME      disc | flat-disc | plummer\n"
+         "  --seed N          scene seed\n"
+         "  --steps N         timed steps per run\n"
+         "  --warmup N        untimed steps per run\n"
+         "  --direct-max-n N  skip the direct engine above this count\n"
+         "  --output FILE     write JSON to FILE instead of stdout\n"
+         "  --trace FILE      record a Chrome trace of every phase to FILE\n"
+         "  --reorder K       Morton-sort the bodies every K steps (0 off)\n"
+         "  --planar MODE     auto | off | on, Barnes-Hut planar quadtree\n"
+         "  --layout LIST     pointer,dfs,bfs,veb Barnes-Hut node orders\n"
+         "  --isa LEVEL       baseline | avx2 | avx512, capped at what the\n"
+         "                    CPU supports (default: the highest)\n"
+         "  --conservation K  measure energy, momentum and angular momentum\n"
+         "                    drift every K steps (timed with the step)\n"
+         "  --fixed-point     integrate positions on a 32-bit fixed-point "
+         "grid\n"
+         "  --autotune        Barnes-Hut with the cached tuning profile, tuned\n"
+         "                    and cached first when missing\n"
+         "  --retune          like --autotune but always tunes\n"
+         "  --check-determinism\n"
+         "                    compare 1-thread and N-thread trajectories bit\n"
+         "                    for bit in deterministic mode, exit 1 on mismatch\n";
+}
+
+static bool parseNodeLayoutList(const std::string &text,
+                                std::vector<NodeLayout> &layouts) {
+  std::vector<std::string> names;
+  if (!parseList(text, names))
+    return false;
+  layouts.clear();
+  for (const std::string &name : names) {
+    NodeLayout layout;
+    if (!parseNodeLayout(name, layout))
+      return false;
+    layouts.push_back(layout);
+  }
+  return true;
+}
+
+static bool parseArguments(int argc, char **argv, BenchConfig &config) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+      return false;
+    if (arg == "--check-determinism") {
+      config.checkDeterminism = true;
+      continue;
+    }
+    if (arg == "--fixed-point") {
+      config.fixedPoint = true;
+      continue;
+    }
+    if (arg == "--autotune" || arg == "--retune") {
+      config.autotune = true;
+      config.retune = config.retune || arg == "--retune";
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "missing value for " << arg << "\n";
+      return false;
+    }
+    std::string value = argv[++i];
+
+    bool ok = true;
+    try {
+      if (arg == "--n")
+        ok = parseList(value, config.counts);
+      else if (arg == "--engines")
+        ok = parseList(value, config.engines);
+      else if (arg == "--theta")
+        ok = parseList(value, config.thetas);
+      else if (arg == "--leaf")
+        ok = parseList(value, config.leafCapacities);
+      else if (arg == "--order")
+        ok = parseList(value, config.expansionOrders);
+      else if (arg == "--max-depth")
+        config.maxDepth = std::max(0, std::stoi(value));
+      else if (arg == "--min-size")
+        config.minSize = std::stof(value);
+      else if (arg == "--threads")
+        ok = parseList(value, config.threadCounts);
+      else if (arg == "--precision")
+        ok = parsePrecisionList(value, config.precisions);
+      else if (arg == "--scene")
+        ok = parseSceneType(value, config.scene);
+      else if (arg == "--seed")
+        config.seed = std::stoul(value);
+      else if (arg == "--steps")
+        config.steps = std::max(1, std::stoi(value));
+      else if (arg == "--warmup")
+        config.warmupSteps = std::max(0, std::stoi(value));
+      else if (arg == "--direct-max-n")
+        config.directMaxCount = std::stoull(value);
+      else if (arg == "--output")
+        config.outputPath = value;
+      else if (arg == "--trace")
+        config.tracePath = value;
+      else if (arg == "--reorder")
+        config.reorderInterval = std::max(0, std::stoi(value));
+      else if (arg == "--conservation")
+        config.conservationInterval = std::max(0, std::stoi(value));
+      else if (arg == "--planar")
+        ok = parsePlanarMode(value, config.planarMode);
+      else if (arg == "--layout")
+        ok = parseNodeLayoutList(value, config.nodeLayouts);
+      else if (arg == "--isa")
+        ok = parseIsaLevel(value, config.isaLevel);
+      else {
+        std::cerr << "unknown option " << arg << "\n";
+        return false;
+      }
+    } catch (const std::exception &) {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "invalid value for " << arg << ": " << value << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// integrates and reorders the bodies, with positions either in the
+// precision's own type or on a fixed-point frame fitted to the scene
+template <typename P> class BenchIntegrator {
+public:
+  using Body = BasicCelestialBody<P>;
+
+  BenchIntegrator(bool fixedPoint, std::vector<Body> &bodies)
+      : fixedPoint(fixedPoint) {
+    if (!fixedPoint || bodies.empty())
+      return;
+
+    glm::dvec3 boundsMin(bodies[0].position), boundsMax(bodies[0].position);
+    for (const Body &body : bodies) {
+      boundsMin = glm::min(boundsMin, glm::dvec3(body.position));
+      boundsMax = glm::max(boundsMax, glm::dvec3(body.position));
+    }
+    frame = FixedPointFrame::fit(boundsMin, boundsMax);
+
+    // snap the starting positions to the grid so both runs agree; the
+    // engines work in the frame, about its centre
+    positions.reserve(bodies.size());
+    for (Body &body : bodies) {
+      positions.push_back(frame.toFixed(glm::dvec3(body.position)));
+      body.position = typename P::Vec3(frame.toLocal(positions.back()));
+    }
+  }
+
+  std::vector<size_t> reorder(std::vector<Body> &bodies) {
+    if (!fixedPoint) {
+      std::vector<size_t> order = mortonOrder(bodies);
+      applyPermutation(bodies, order);
+      return order;
+    }
+    std::vector<size_t> order = mortonOrder(positions);
+    applyPermutation(bodies, order);
+    applyPermutation(positions, order);
+    return order;
+  }
+
+  void step(std::vector<Body> &bodies, float deltaTime) {
+    if (fixedPoint) {
+      integrateFixedPoint(bodies, positions, frame, deltaTime);
+      return;
+    }
+    integrateBodies(bodies, deltaTime);
+  }
+
+private:
+  bool fixedPoint;
+  FixedPointFrame frame;
+  std::vector<FixedPosition> positions;
+};
+
+template <typename P>
+static BenchResult runBenchmark(const BenchConfig &config,
+                                const std::vector<CelestialBody> &scene,
+                                BasicGravityEngine<P> &engine) {
+  std::vector<BasicCelestialBody<P>> bodies(scene.begin(), scene.end());
+  BenchIntegrator<P> integrator(config.fixedPoint, bodies);
+  std::vector<double> stepMs;
+  InteractionCounters totalCounters;
+  ConservationMonitor monitor(config.conservationInterval);
+  monitor.threadCount = engine.threadCount;
+
+  for (int step = 0; step < config.warmupSteps + config.steps; step++) {
+    auto start = std::chrono::steady_clock::now();
+
+    if (config.reorderInterval > 0 && step % config.reorderInterval == 0) {
+      PROFILE_SCOPE("reorderBodies");
+      engine.permuteBodyData(integrator.reorder(bodies));
+    }
+
+    engine.computeAccelerations(bodies, BENCH_GRAVITATIONAL_CONSTANT);
+    {
+      PROFILE_SCOPE("integrate");
+      integrator.step(bodies, BENCH_TIME_STEP);
+    }
+    // the baseline is the first timed step
+    if (step >= config.warmupSteps)
+      monitor.observe(bodies, BENCH_GRAVITATIONAL_CONSTANT,
+                      (step - config.warmupSteps + 1) * BENCH_TIME_STEP);
+
+    auto end = std::chrono::steady_clock::now();
+    if (step < config.warmupSteps)
+      continue;
+
+    stepMs.push_back(
+        std::chrono::duration<double, std::milli>(end - start).count());
+    totalCounters += engine.lastCounters;
+  }
+
+  double totalMs = 0.0;
+  for (double ms : stepMs)
+    totalMs += ms;
+  double totalInteractions = (double)totalCounters.interactions();
+
+  BenchResult result;
+  result.engine = engine.name();
+  result.count = bodies.size();
+  result.theta = 0.0f;
+  result.leafCapacity = 0;
+  result.expansionOrder = 0;
+  result.maxDepth = 0;
+  result.minSize = 0.0f;
+  result.threadCount = engine.threadCount;
+  result.medianMs = percentile(stepMs, 0.5);
+  result.p95Ms = percentile(stepMs, 0.95);
+  result.meanMs = totalMs / stepMs.size();
+  result.interactionsPerStep = totalInteractions / stepMs.size();
+  result.interactionsPerSecond =
+      totalMs > 0.0 ? totalInteractions / (totalMs * 1e-3) : 0.0;
+  result.bytesPerBody =
+      bodies.empty() ? 0.0
+                     : (double)(bodies.capacity() *
+                                    sizeof(BasicCelestialBody<P>) +
+                                engine.memoryBytes()) /
+                           bodies.size();
+  result.bodyBodyPerStep = (double)totalCounters.bodyBody / stepMs.size();
+  result.bodyCellPerStep = (double)totalCounters.bodyCell / stepMs.size();
+  result.nodesOpenedPerStep =
+      (double)totalCounters.nodesOpened / stepMs.size();
+  result.conservation = config.conservationInterval > 0;
+  result.drift = monitor.maxDrift();
+  return result;
+}
+
+static void writeHistogram(std::ostream &out,
+                           const std::vector<size_t> &histogram) {
+  out << "[";
+  for (size_t i = 0; i < histogram.size(); i++)
+    out << (i == 0 ? "" : ", ") << histogram[i];
+  out << "]";
+}
+
+static void writeJson(std::ostream &out, const BenchConfig &config,
+                      const std::vector<BenchResult> &results) {
+  out << "{\n";
+  out << "  \"benchmark\": \"gravity_bench\",\n";
+  out << "  \"scene\": \"" << sceneTypeName(config.scene) << "\",\n";
+  out << "  \"seed\": " << config.seed << ",\n";
+  out << "  \"steps\": " << config.steps << ",\n";
+  out << "  \"warmupSteps\": " << config.warmupSteps << ",\n";
+  out << "  \"reorderInterval\": " << config.reorderInterval << ",\n";
+  out << "  \"conservationInterval\": " << config.conservationInterval
+      << ",\n";
+  out << "  \"fixedPoint\": " << (config.fixedPoint ? "true" : "false")
+      << ",\n";
+  out << "  \"planar\": \"" << planarModeName(config.planarMode) << "\",\n";
+  out << "  \"hardwareThreads\": " << hardwareThreadCount() << ",\n";
+  out << "  \"isa\": \"" << isaLevelName(activeIsaLevel()) << "\",\n";
+  out << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &r = results[i];
+    out << (i == 0 ? "\n" : ",\n");
+    out << "    {\"engine\": \"" << r.engine << "\", \"precision\": \""
+        << r.precision << "\", \"n\": " << r.count
+        << ", \"theta\": " << r.theta << ", \"leafCapacity\": "
+        << r.leafCapacity << ", \"expansionOrder\": " << r.expansionOrder
+        << ", \"maxDepth\": " << r.maxDepth << ", \"minSize\": " << r.minSize;
+    if (!r.nodeLayout.empty())
+      out << ", \"layout\": \"" << r.nodeLayout << "\"";
+    out << ", \"threads\": " << r.threadCount
+        << ", \"medianStepMs\": " << r.medianMs
+        << ", \"p95StepMs\": " << r.p95Ms << ", \"meanStepMs\": " << r.meanMs
+        << ", \"interactionsPerStep\": " << r.interactionsPerStep
+        << ", \"interactionsPerSecond\": " << r.interactionsPerSecond
+        << ", \"bytesPerBody\": " << r.bytesPerBody
+        << ", \"bodyBodyPerStep\": " << r.bodyBodyPerStep
+        << ", \"bodyCellPerStep\": " << r.bodyCellPerStep
+        << ", \"nodesOpenedPerStep\": " << r.nodesOpenedPerStep;
+    if (r.conservation) {
+      out << ", \"energyDrift\": " << r.drift.energy;
+      // not conserved with fixed bodies in the scene
+      if (r.drift.momentumConserved)
+        out << ", \"momentumDrift\": " << r.drift.momentum;
+      if (r.drift.angularMomentumConserved)
+        out << ", \"angularMomentumDrift\": " << r.drift.angularMomentum;
+    }
+    if (r.tree.nodeCount > 0) {
+      out << ", \"tree\": {\"dimensions\": " << r.tree.dimensions
+          << ", \"nodes\": " << r.tree.nodeCount
+          << ", \"leaves\": " << r.tree.leafCount
+          << ", \"emptyLeaves\": " << r.tree.emptyLeafCount
+          << ", \"bytes\": " << r.tree.memoryBytes
+          << ", \"escapers\": " << r.tree.escaperCount
+          << ", \"depthHistogram\": ";
+      writeHistogram(out, r.tree.depthHistogram);
+      out << ", \"leafOccupancy\": ";
+      writeHistogram(out, r.tree.leafOccupancy);
+      out << "}";
+    }
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+template <typename P>
+static std::unique_ptr<BasicGravityEngine<P>>
+createEngine(const BenchConfig &config, const std::string &name) {
+  if (name == "direct")
+    return std::make_unique<BasicDirectEngine<P>>();
+  if (name == "barnes-hut") {
+    auto engine = std::make_unique<BasicBarnesHutEngine<P>>(
+        config.thetas.front(), config.leafCapacities.front(),
+        config.expansionOrders.front());
+    engine->maxDepth = config.maxDepth;
+    engine->minSize = config.minSize;
+    engine->planarMode = config.planarMode;
+    engine->nodeLayout = config.nodeLayouts.front();
+    return engine;
+  }
+  if (name == "auto") {
+    auto engine = std::make_unique<BasicAutoEngine<P>>();
+    engine->barnesHut.theta = config.thetas.front();
+    engine->barnesHut.leafCapacity = config.leafCapacities.front();
+    engine->barnesHut.expansionOrder = config.expansionOrders.front();
+    engine->barnesHut.maxDepth = config.maxDepth;
+    engine->barnesHut.minSize = config.minSize;
+    engine->barnesHut.planarMode = config.planarMode;
+    engine->barnesHut.nodeLayout = config.nodeLayouts.front();
+    return engine;
+  }
+  return nullptr;
+}
+
+template <typename P>
+static void runDeterministic(const BenchConfig &config,
+                             BasicGravityEngine<P> &engine,
+                             std::vector<BasicCelestialBody<P>> &bodies) {
+  engine.deterministic = true;
+  BenchIntegrator<P> integrator(config.fixedPoint, bodies);
+  for (int step = 0; step < config.steps; step++) {
+    engine.computeAccelerations(bodies, BENCH_GRAVITATIONAL_CONSTANT);
+    integrator.step(bodies, BENCH_TIME_STEP);
+  }
+}
+
+template <typename Body>
+static bool sameBits(const std::vector<Body> &a, const std::vector<Body> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (memcmp(&a[i].position, &b[i].position, sizeof(a[i].position)) != 0 ||
+        memcmp(&a[i].velocity, &b[i].velocity, sizeof(a[i].velocity)) != 0)
+      return false;
+  }
+  return true;
+}
+
+// runs every engine with one thread and with each requested thread count,
+// then with one thread at every ISA level the CPU supports, and compares
+// the resulting trajectories bit for bit. each run gets a fresh engine so
+// no tree, cost or warm-start state carries over from the previous one
+template <typename P>
+static bool runFresh(const BenchConfig &config, const std::string &engineName,
+                     int threads, std::vector<BasicCelestialBody<P>> &bodies) {
+  std::unique_ptr<BasicGravityEngine<P>> engine =
+      createEngine<P>(config, engineName);
+  if (!engine) {
+    std::cerr << "unknown engine " << engineName << "\n";
+    return false;
+  }
+  engine->threadCount = threads;
+  runDeterministic(config, *engine, bodies);
+  return true;
+}
+
+template <typename P>
+static bool checkDeterminism(const BenchConfig &config, const char *precision) {
+  using Body = BasicCelestialBody<P>;
+  bool passed = true;
+  std::vector<CelestialBody> scene;
+  IsaLevel requestedLevel = activeIsaLevel();
+
+  for (size_t count : config.counts) {
+    generateScene(scene, config.scene, count, config.seed,
+                  BENCH_GRAVITATIONAL_CONSTANT);
+
+    for (const std::string &engineName : config.engines) {
+      if (engineName == "direct" && count > config.directMaxCount)
+        continue;
+
+      std::vector<Body> reference(scene.begin(), scene.end());
+      if (!runFresh(config, engineName, 1, reference))
+        return false;
+
+      for (int threads : config.threadCounts) {
+        if (threads <= 1)
+          continue;
+        std::vector<Body> bodies(scene.begin(), scene.end());
+        runFresh(config, engineName, threads, bodies);
+
+        bool same = sameBits(reference, bodies);
+        passed = passed && same;
+        std::cerr << (same ? "PASS " : "FAIL ") << engineName << " "
+                  << precision << " n=" << count << " threads=1 vs "
+                  << threads << "\n";
+      }
+
+      for (IsaLevel level :
+           {IsaLevel::Baseline, IsaLevel::Avx2, IsaLevel::Avx512}) {
+        if (level == requestedLevel || setIsaLevel(level) != level)
+          continue;
+        std::vector<Body> bodies(scene.begin(), scene.end());
+        runFresh(config, engineName, 1, bodies);
+        setIsaLevel(requestedLevel);
+
+        bool same = sameBits(reference, bodies);
+        passed = passed && same;
+        std::cerr << (same ? "PASS " : "FAIL ") << engineName << " "
+                  << precision << " n=" << count << " isa="
+                  << isaLevelName(requestedLevel) << " vs "
+                  << isaLevelName(level) << "\n";
+      }
+    }
+  }
+  return passed;
+}
+
+// every engine and parameter combination at one precision for one scene
+template <typename P>
+static bool runEngines(const BenchConfig &config,
+                       const std::vector<CelestialBody> &scene,
+                       const char *precision, const TuningCache *tuningCache,
+                       std::vector<BenchResult> &results) {
+  size_t count = scene.size();
+  for (const std::string &engineName : config.engines) {
+    for (int threads : config.threadCounts) {
+      if (engineName == "direct") {
+        if (count > config.directMaxCount) {
+          std::cerr << "skipping direct at n=" << count << "\n";
+          break;
+        }
+        BasicDirectEngine<P> engine;
+        engine.threadCount = threads;
+        std::cerr << "direct " << precision << " n=" << count
+                  << " threads=" << threads << "\n";
+        BenchResult result = runBenchmark(config, scene, engine);
+        result.precision = precision;
+        results.push_back(result);
+      } else if (engineName == "barnes-hut") {
+        for (float theta : config.thetas) {
+          for (int leafCapacity : config.leafCapacities) {
+            for (int expansionOrder : config.expansionOrders) {
+              for (NodeLayout layout : config.nodeLayouts) {
+                BasicBarnesHutEngine<P> engine(theta, leafCapacity,
+                                               expansionOrder);
+                engine.threadCount = threads;
+                engine.maxDepth = config.maxDepth;
+                engine.minSize = config.minSize;
+                engine.planarMode = config.planarMode;
+                engine.nodeLayout = layout;
+                std::cerr << "barnes-hut " << precision << " n=" << count
+                          << " theta=" << theta << " leaf=" << leafCapacity
+                          << " order=" << expansionOrder
+                          << " layout=" << nodeLayoutName(layout)
+                          << " threads=" << threads << "\n";
+                BenchResult result = runBenchmark(config, scene, engine);
+                result.precision = precision;
+                result.theta = theta;
+                result.leafCapacity = leafCapacity;
+                result.expansionOrder = expansionOrder;
+                result.maxDepth = engine.maxDepth;
+                result.minSize = engine.minSize;
+                result.nodeLayout = nodeLayoutName(layout);
+                result.tree = engine.treeStats();
+                results.push_back(result);
+              }
+            }
+          }
+        }
+      } else if (engineName == "auto") {
+        BasicAutoEngine<P> engine;
+        engine.threadCount = threads;
+        engine.tuningCache = tuningCache;
+        engine.barnesHut.theta = config.thetas.front();
+        engine.barnesHut.leafCapacity = config.leafCapacities.front();
+        engine.barnesHut.expansionOrder = config.expansionOrders.front();
+        engine.barnesHut.maxDepth = config.maxDepth;
+        engine.barnesHut.minSize = config.minSize;
+        engine.barnesHut.planarMode = config.planarMode;
+        engine.barnesHut.nodeLayout = config.nodeLayouts.front();
+        std::cerr << "auto " << precision << " n=" << count
+                  << " threads=" << threads << "\n";
+        BenchResult result = runBenchmark(config, scene, engine);
+        const EngineCosts &costs = engine.costs();
+        std::cerr << "  picked " << engine.current().name() << ", direct "
+                  << costs.direct << " vs barnes-hut " << costs.barnesHut
+                  << (costs.cached ? " ms (cached)" : " ms") << "\n";
+        result.precision = precision;
+        result.theta = engine.barnesHut.theta;
+        result.leafCapacity = engine.barnesHut.leafCapacity;
+        result.expansionOrder = engine.barnesHut.expansionOrder;
+        result.maxDepth = engine.barnesHut.maxDepth;
+        result.minSize = engine.barnesHut.minSize;
+        results.push_back(result);
+      } else {
+        std::cerr << "unknown engine " << engineName << "\n";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig config;
+  if (!parseArguments(argc, argv, config)) {
+    printUsage();
+    return 1;
+  }
+
+  if (setIsaLevel(config.isaLevel) != config.isaLevel)
+    std::cerr << isaLevelName(config.isaLevel) << " not supported, using "
+              << isaLevelName(activeIsaLevel()) << "\n";
+
+  if (config.checkDeterminism) {
+    bool passed = true;
+    for (PrecisionMode mode : config.precisions) {
+      const char *name = precisionModeName(mode);
+      switch (mode) {
+      case PrecisionMode::Float:
+        passed = checkDeterminism<FloatPrecision>(config, name) && passed;
+        break;
+      case PrecisionMode::Double:
+        passed = checkDeterminism<DoublePrecision>(config, name) && passed;
+        break;
+      case PrecisionMode::Mixed:
+        passed = checkDeterminism<MixedPrecision>(config, name) && passed;
+        break;
+      }
+    }
+    return passed ? 0 : 1;
+  }
+
+  if (!config.tracePath.empty())
+    Profiler::instance().setEnabled(true);
+
+  std::vector<BenchResult> results;
+  std::vector<CelestialBody> scene;
+  TuningCache tuningCache;
+  if (config.autotune)
+    tuningCache.load();
+
+  for (size_t count : config.counts) {
+    generateScene(scene, config.scene, count, config.seed,
+                  BENCH_GRAVITATIONAL_CONSTANT);
+
+    BenchConfig runConfig = config;
+    if (config.autotune) {
+      TuningProfile profile;
+      if (config.retune || !tuningCache.find(count, profile)) {
+        std::cerr << "tuning n=" << count << "\n";
+        profile = autoTune(scene, BENCH_GRAVITATIONAL_CONSTANT);
+        tuningCache.store(count, profile);
+        if (!tuningCache.save())
+          std::cerr << "failed to write " << tuningCache.filePath() << "\n";
+      }
+      std::cerr << "profile n=" << count << " theta=" << profile.theta
+                << " leaf=" << profile.leafCapacity
+                << " order=" << profile.expansionOrder
+                << " maxDepth=" << profile.maxDepth
+                << " threads=" << profile.threadCount
+                << " p99Error=" << profile.p99Error << "\n";
+      runConfig.thetas = {profile.theta};
+      runConfig.leafCapacities = {profile.leafCapacity};
+      runConfig.expansionOrders = {profile.expansionOrder};
+      runConfig.maxDepth = profile.maxDepth;
+      runConfig.minSize = profile.minSize;
+      runConfig.threadCounts = {profile.threadCount};
+    }
+
+    for (PrecisionMode mode : config.precisions) {
+      const char *name = precisionModeName(mode);
+      bool ok = true;
+      switch (mode) {
+      case PrecisionMode::Float:
+        ok = runEngines<FloatPrecision>(runConfig, scene, name,
+                                    config.autotune ? &tuningCache : nullptr,
+                                    results);
+        break;
+      case PrecisionMode::Double:
+        ok = runEngines<DoublePrecision>(runConfig, scene, name,
+                                    config.autotune ? &tuningCache : nullptr,
+                                    results);
+        break;
+      case PrecisionMode::Mixed:
+        ok = runEngines<MixedPrecision>(runConfig, scene, name,
+                                    config.autotune ? &tuningCache : nullptr,
+                                    results);
+        break;
+      }
+      if (!ok)
+        return 1;
+    }
+  }
+
+  if (!config.tracePath.empty()) {
+    Profiler &profiler = Profiler::instance();
+    profiler.setEnabled(false);
+    profiler.printSummary(std::cerr);
+    std::ofstream trace(config.tracePath);
+    profiler.writeChromeTrace(trace);
+  }
+
+  if (config.outputPath.empty()) {
+    writeJson(std::cout, config, results);
+  } else {
+    std::ofstream out(config.outputPath);
+    if (!out) {
+      std::cerr << "failed to open " << config.outputPath << "\n";
+      return 1;
+    }
+    writeJson(out, config, results);
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+#include "include/bodyIdMap.h"
+
+BodyIdMap::BodyIdMap() {}
+
+void BodyIdMap::clear() { slots.clear(); }
+
+uint64_t BodyIdMap::insert(CelestialBody &body, size_t slot) {
+  body.id = slots.size();
+  slots.push_back(slot);
+  return body.id;
+}
+
+void BodyIdMap::erase(uint64_t id) {
+  if (id < slots.size())
+    slots[id] = INVALID_BODY_SLOT;
+}
+
+void BodyIdMap::moveSlot(uint64_t id, size_t slot) {
+  if (id >= slots.size())
+    slots.resize(id + 1, INVALID_BODY_SLOT);
+  slots[id] = slot;
+}
+
+void BodyIdMap::rebuild(const std::vector<CelestialBody> &bodies) {
+  for (size_t slot = 0; slot < bodies.size(); slot++) {
+    if (bodies[slot].id != INVALID_BODY_ID)
+      moveSlot(bodies[slot].id, slot);
+  }
+}
+
+size_t BodyIdMap::slotOf(uint64_t id) const {
+  return id < slots.size() ? slots[id] : INVALID_BODY_SLOT;
+}
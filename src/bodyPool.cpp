@@ -0,0 +1,99 @@
+#include "include/bodyPool.h"
+#include "include/spatialSort.h"
+#include <glm/geometric.hpp>
+#include <utility>
+
+BodyPool::BodyPool() {}
+
+void BodyPool::clear() {
+  bodies.clear();
+  visuals.clear();
+  ids.clear();
+  freeSlots.clear();
+}
+
+uint64_t BodyPool::add(const CelestialBody &body, const BodyVisual &visual) {
+  size_t slot;
+  if (!freeSlots.empty()) {
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+    bodies[slot] = body;
+    visuals[slot] = visual;
+  } else {
+    slot = bodies.size();
+    bodies.push_back(body);
+    visuals.push_back(visual);
+  }
+
+  CelestialBody &added = bodies[slot];
+  added.setActive(true);
+  added.id = INVALID_BODY_ID;
+  return ids.insert(added, slot);
+}
+
+bool BodyPool::remove(uint64_t id) {
+  size_t slot = ids.slotOf(id);
+  if (slot == INVALID_BODY_SLOT)
+    return false;
+
+  // a dead slot has no mass, so engines that do not skip it still see no
+  // force from it
+  CelestialBody &body = bodies[slot];
+  body.setActive(false);
+  body.mass = 0.0f;
+  body.acceleration = glm::vec3(0.0f);
+  visuals[slot].trajectory.clear();
+  body.id = INVALID_BODY_ID;
+
+  ids.erase(id);
+  freeSlots.push_back(slot);
+  return true;
+}
+
+size_t BodyPool::removeBeyond(const glm::vec3 &center, float radius) {
+  float radiusSquared = radius * radius;
+  size_t removed = 0;
+  for (const auto &body : bodies) {
+    if (!body.isActive() || body.isFixed())
+      continue;
+    glm::vec3 offset = body.position - center;
+    if (glm::dot(offset, offset) > radiusSquared && remove(body.id))
+      removed++;
+  }
+  return removed;
+}
+
+bool BodyPool::needsCompaction() const {
+  return !freeSlots.empty() &&
+         freeSlots.size() >= bodies.size() * BODY_COMPACTION_FRACTION;
+}
+
+std::vector<size_t> BodyPool::compact() {
+  std::vector<size_t> order;
+  order.reserve(activeCount());
+
+  size_t write = 0;
+  for (size_t read = 0; read < bodies.size(); read++) {
+    if (!bodies[read].isActive())
+      continue;
+    if (read != write) {
+      bodies[write] = bodies[read];
+      visuals[write] = std::move(visuals[read]);
+    }
+    order.push_back(read);
+    write++;
+  }
+
+  // shrinking keeps the capacity, later insertions reuse it
+  bodies.erase(bodies.begin() + write, bodies.end());
+  visuals.erase(visuals.begin() + write, visuals.end());
+  freeSlots.clear();
+  ids.rebuild(bodies);
+  return order;
+}
+
+void BodyPool::permute(const std::vector<size_t> &order) {
+  applyPermutation(bodies, order);
+  applyPermutation(visuals, order);
+  ids.rebuild(bodies);
+}
@@ -1,35 +1,29 @@
 #include "include/celestialBody.h"
+#include "include/cpuFeatures.h"
 #include <glm/gtc/matrix_transform.hpp>
 
-CelestialBody::CelestialBody(glm::vec3 pos, glm::vec3 vel, float m, float r,
-                             glm::vec3 col, bool fixed)
-    : position(pos), velocity(vel), mass(m), radius(r), color(col),
-      isFixed(fixed) {
-  acceleration = glm::vec3(0.0f);
+template <typename P>
+BasicCelestialBody<P>::BasicCelestialBody(Vec3 pos, Vec3 vel, Real m,
+                                          bool fixed)
+    : position(pos), velocity(vel), mass(m),
+      flags(BODY_FLAG_ACTIVE | (fixed ? BODY_FLAG_FIXED : 0u)),
+      id(INVALID_BODY_ID) {
+  acceleration = Accum(0.0f);
 }
 
-void CelestialBody::applyGravity(const CelestialBody &other, float G) {
-  if (&other == this)
-    return;
-
-  glm::vec3 direction = other.position - position;
-  float distance = glm::length(direction);
-
-  if (distance < 0.1f)
-    distance = 0.1f;
-
-  direction = glm::normalize(direction);
-
-  // gravitational force : F = G * m1 * m2 / r^2
-  float forceMagnitude = G * mass * other.mass / (distance * distance);
-
-  // F = ma
-  acceleration += direction * (forceMagnitude / mass);
+template <typename P> void BasicCelestialBody<P>::setActive(bool active) {
+  if (active)
+    flags |= BODY_FLAG_ACTIVE;
+  else
+    flags &= ~BODY_FLAG_ACTIVE;
 }
 
-void CelestialBody::update(float deltaTime) {
-  if (isFixed) {
-    acceleration = glm::vec3(0.0f); // Fixed bodies don't move
+template <typename P> void BasicCelestialBody<P>::update(float deltaTime) {
+  if (!isActive())
+    return;
+
+  if (isFixed()) {
+    acceleration = Accum(0.0f); // Fixed bodies don't move
     return;
   }
 
@@ -39,21 +33,47 @@ void CelestialBody::update(float deltaTime) {
    *  x(t+dt) = x(t) + v(t) * dt + 0.5 * a(t) * dt^2
    * */
 
-  velocity += acceleration * deltaTime;
-  position +=
-      velocity * deltaTime + 0.5f * acceleration * deltaTime * deltaTime;
+  Real dt = deltaTime;
+  Vec3 a(acceleration);
+  velocity += a * dt;
+  position += velocity * dt + Real(0.5f) * a * dt * dt;
+
+  acceleration = Accum(0.0f);
+}
 
-  acceleration = glm::vec3(0.0f);
+template <typename P>
+void integrateBodies(std::vector<BasicCelestialBody<P>> &bodies,
+                     float deltaTime) {
+  dispatchKernel([&]() {
+    for (BasicCelestialBody<P> &body : bodies)
+      body.update(deltaTime);
+  });
 }
 
-void CelestialBody::addTrajectoryPoint() {
+template void
+integrateBodies(std::vector<BasicCelestialBody<FloatPrecision>> &bodies,
+                float deltaTime);
+template void
+integrateBodies(std::vector<BasicCelestialBody<DoublePrecision>> &bodies,
+                float deltaTime);
+template void
+integrateBodies(std::vector<BasicCelestialBody<MixedPrecision>> &bodies,
+                float deltaTime);
+
+template class BasicCelestialBody<FloatPrecision>;
+template class BasicCelestialBody<DoublePrecision>;
+template class BasicCelestialBody<MixedPrecision>;
+
+BodyVisual::BodyVisual(glm::vec3 col, float r) : color(col), radius(r) {}
+
+void BodyVisual::addTrajectoryPoint(const glm::vec3 &position) {
   trajectory.push_back(position);
 
   if (trajectory.size() > MAX_TRAJECTORY_POINTS)
     trajectory.pop_front();
 }
 
-void CelestialBody::clearTrajectory() {
+void BodyVisual::clearTrajectory(const glm::vec3 &position) {
   trajectory.clear();
   trajectory.push_back(position);
 }
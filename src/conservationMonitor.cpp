@@ -0,0 +1,197 @@
+#include "include/conservationMonitor.h"
+#include "include/octreeNode.h"
+#include "include/parallel.h"
+#include "include/profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <limits>
+
+ConservationMonitor::ConservationMonitor(int interval)
+    : interval(interval), theta(CONSERVATION_THETA),
+      energyAlert(CONSERVATION_ENERGY_ALERT),
+      momentumAlert(CONSERVATION_MOMENTUM_ALERT),
+      angularMomentumAlert(CONSERVATION_ANGULAR_MOMENTUM_ALERT),
+      threadCount(hardwareThreadCount()), log(nullptr), steps(0),
+      haveBaseline(false), alerting(false), headerWritten(false) {}
+
+void ConservationMonitor::reset() {
+  haveBaseline = false;
+  alerting = false;
+  lastDrift = ConservationDrift();
+  worstDrift = ConservationDrift();
+}
+
+template <typename Vec3> static bool isFinite(const Vec3 &v) {
+  return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+}
+
+template <typename P>
+ConservationSample
+ConservationMonitor::measure(const std::vector<BasicCelestialBody<P>> &bodies,
+                             float G) const {
+  using Body = BasicCelestialBody<P>;
+  using Node = BasicOctreeNode<P, 3>;
+  using Vec3 = typename P::Vec3;
+  using Real = typename P::Real;
+  PROFILE_SCOPE("conservation");
+
+  ConservationSample sample;
+  // the tree needs mutable bodies, the caller's are left alone
+  std::vector<Body> copies;
+  copies.reserve(bodies.size());
+  glm::dvec3 pivot(0.0);
+  for (const Body &body : bodies) {
+    if (!body.isActive() || !isFinite(body.position))
+      continue;
+    copies.push_back(body);
+    if (body.isFixed()) {
+      sample.fixedCount++;
+      pivot = glm::dvec3(body.position);
+    }
+  }
+  sample.bodyCount = copies.size();
+  if (copies.empty())
+    return sample;
+  if (sample.fixedCount != 1)
+    pivot = glm::dvec3(0.0);
+
+  for (const Body &body : copies) {
+    glm::dvec3 velocity(body.velocity);
+    glm::dvec3 momentum = velocity * (double)body.mass;
+    glm::dvec3 angular =
+        glm::cross(glm::dvec3(body.position) - pivot, momentum);
+    sample.kinetic += 0.5 * body.mass * glm::dot(velocity, velocity);
+    sample.momentum += momentum;
+    sample.angularMomentum += angular;
+    sample.momentumScale += glm::length(momentum);
+    sample.angularMomentumScale += glm::length(angular);
+  }
+
+  Vec3 low(std::numeric_limits<Real>::max());
+  Vec3 high(std::numeric_limits<Real>::lowest());
+  std::vector<Body *> pointers(copies.size());
+  for (size_t i = 0; i < copies.size(); i++) {
+    low = glm::min(low, copies[i].position);
+    high = glm::max(high, copies[i].position);
+    pointers[i] = &copies[i];
+  }
+  Vec3 extent = high - low;
+  Real size = std::max(extent.x, std::max(extent.y, extent.z)) * Real(1.01f) +
+              Real(1.0f);
+  OctreeLimits limits;
+  limits.leafCapacity = CONSERVATION_LEAF_CAPACITY;
+  Node root(Node::project((low + high) * Real(0.5f)), size, 0, limits);
+  std::vector<Body *> scratch(pointers.size());
+  root.buildSubtree(pointers.data(), pointers.data() + pointers.size(),
+                    scratch.data());
+
+  // per body, then summed in order, so the result does not depend on the
+  // thread count
+  std::vector<double> potentials(copies.size());
+  parallelFor(0, copies.size(), std::max(1, threadCount),
+              [&](size_t begin, size_t end, int) {
+                for (size_t i = begin; i < end; i++)
+                  potentials[i] = copies[i].mass *
+                                  root.calculatePotential(copies[i], G, theta);
+              });
+  for (double potential : potentials)
+    sample.potential += potential;
+  // every pair was counted from both ends
+  sample.potential *= 0.5;
+  return sample;
+}
+
+template <typename P>
+bool ConservationMonitor::observe(
+    const std::vector<BasicCelestialBody<P>> &bodies, float G, double time) {
+  if (interval <= 0 || steps++ % interval != 0)
+    return false;
+
+  ConservationSample sample = measure(bodies, G);
+  sample.step = steps - 1;
+  sample.time = time;
+  record(sample);
+  return true;
+}
+
+static double relativeDrift(double value, double reference, double scale) {
+  return scale > 0.0 ? std::abs(value - reference) / scale : 0.0;
+}
+
+static double relativeDrift(const glm::dvec3 &value,
+                            const glm::dvec3 &reference, double scale) {
+  return scale > 0.0 ? glm::length(value - reference) / scale : 0.0;
+}
+
+void ConservationMonitor::record(const ConservationSample &sample) {
+  // bodies escaping, merging or being added change the totals on purpose
+  if (haveBaseline && sample.bodyCount != first.bodyCount)
+    reset();
+  if (!haveBaseline) {
+    first = sample;
+    haveBaseline = true;
+  }
+  last = sample;
+
+  ConservationDrift drift;
+  drift.energy =
+      relativeDrift(sample.energy(), first.energy(), std::abs(first.energy()));
+  drift.momentum =
+      relativeDrift(sample.momentum, first.momentum, first.momentumScale);
+  drift.angularMomentum =
+      relativeDrift(sample.angularMomentum, first.angularMomentum,
+                    first.angularMomentumScale);
+  drift.momentumConserved = sample.fixedCount == 0;
+  drift.angularMomentumConserved = sample.fixedCount <= 1;
+  lastDrift = drift;
+
+  worstDrift.energy = std::max(worstDrift.energy, drift.energy);
+  worstDrift.momentum = std::max(worstDrift.momentum, drift.momentum);
+  worstDrift.angularMomentum =
+      std::max(worstDrift.angularMomentum, drift.angularMomentum);
+  worstDrift.momentumConserved = drift.momentumConserved;
+  worstDrift.angularMomentumConserved = drift.angularMomentumConserved;
+
+  if (log != nullptr) {
+    if (!headerWritten) {
+      writeConservationHeader(*log);
+      headerWritten = true;
+    }
+    writeConservationLine(*log, sample, drift);
+  }
+
+  bool over = drift.energy > energyAlert ||
+              (drift.momentumConserved && drift.momentum > momentumAlert) ||
+              (drift.angularMomentumConserved &&
+               drift.angularMomentum > angularMomentumAlert);
+  if (over && !alerting && onAlert)
+    onAlert(sample, drift);
+  alerting = over;
+}
+
+void writeConservationHeader(std::ostream &out) {
+  out << "step,time,bodies,kinetic,potential,energy,energyDrift,"
+         "momentumDrift,angularMomentumDrift\n";
+}
+
+void writeConservationLine(std::ostream &out, const ConservationSample &sample,
+                           const ConservationDrift &drift) {
+  out << sample.step << "," << sample.time << "," << sample.bodyCount << ","
+      << sample.kinetic << "," << sample.potential << "," << sample.energy()
+      << "," << drift.energy << "," << drift.momentum << ","
+      << drift.angularMomentum << "\n";
+}
+
+template ConservationSample
+ConservationMonitor::measure(const std::vector<CelestialBody> &, float) const;
+template ConservationSample ConservationMonitor::measure(
+    const std::vector<BasicCelestialBody<DoublePrecision>> &, float) const;
+template ConservationSample ConservationMonitor::measure(
+    const std::vector<BasicCelestialBody<MixedPrecision>> &, float) const;
+template bool ConservationMonitor::observe(const std::vector<CelestialBody> &,
+                                           float, double);
+template bool ConservationMonitor::observe(
+    const std::vector<BasicCelestialBody<DoublePrecision>> &, float, double);
+template bool ConservationMonitor::observe(
+    const std::vector<BasicCelestialBody<MixedPrecision>> &, float, double);
@@ -0,0 +1,86 @@
+#include "include/cpuFeatures.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+
+static IsaLevel probeIsaLevel() {
+#if ISA_MULTIVERSION
+  // also checks that the OS saves the wider registers; the Morton keys'
+  // pdep path rides on the Avx2 level, so it requires BMI2 as well
+  __builtin_cpu_init();
+  bool avx2 =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+  if (avx2 && __builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512dq") &&
+      __builtin_cpu_supports("avx512bw"))
+    return IsaLevel::Avx512;
+  if (avx2)
+    return IsaLevel::Avx2;
+#endif
+  return IsaLevel::Baseline;
+}
+
+IsaLevel detectedIsaLevel() {
+  static const IsaLevel level = probeIsaLevel();
+  return level;
+}
+
+static IsaLevel clampToDetected(IsaLevel level) {
+  return std::min(level, detectedIsaLevel());
+}
+
+static IsaLevel initialIsaLevel() {
+  const char *name = std::getenv("GRAVITY_ISA");
+  IsaLevel level = detectedIsaLevel();
+  if (name != nullptr && !parseIsaLevel(name, level))
+    std::cerr << "ignoring unknown GRAVITY_ISA=" << name << "\n";
+  return clampToDetected(level);
+}
+
+// -1 until the first query, then an IsaLevel
+static std::atomic<int> activeLevel{-1};
+
+IsaLevel activeIsaLevel() {
+  int level = activeLevel.load(std::memory_order_relaxed);
+  if (level < 0) {
+    level = (int)initialIsaLevel();
+    activeLevel.store(level, std::memory_order_relaxed);
+  }
+  return (IsaLevel)level;
+}
+
+IsaLevel setIsaLevel(IsaLevel level) {
+  level = clampToDetected(level);
+  activeLevel.store((int)level, std::memory_order_relaxed);
+  return level;
+}
+
+bool parseIsaLevel(const std::string &name, IsaLevel &level) {
+  if (name == "baseline") {
+    level = IsaLevel::Baseline;
+    return true;
+  }
+  if (name == "avx2") {
+    level = IsaLevel::Avx2;
+    return true;
+  }
+  if (name == "avx512") {
+    level = IsaLevel::Avx512;
+    return true;
+  }
+  return false;
+}
+
+const char *isaLevelName(IsaLevel level) {
+  switch (level) {
+  case IsaLevel::Baseline:
+    return "baseline";
+  case IsaLevel::Avx2:
+    return "avx2";
+  case IsaLevel::Avx512:
+    return "avx512";
+  }
+  return "unknown";
+}
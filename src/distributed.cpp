@@ -0,0 +1,275 @@
+#include "include/benchCommon.h"
+#include "include/celestialBody.h"
+#include "include/domainDecomposition.h"
+#include "include/gravityEngine.h"
+#include "include/sceneGenerator.h"
+#include "include/taskScheduler.h"
+#include "include/transport.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#ifdef GRAVITY_WITH_MPI
+#include <mpi.h>
+#endif
+
+#define DISTRIBUTED_GRAVITATIONAL_CONSTANT 0.1f
+#define DISTRIBUTED_TIME_STEP 0.01f
+
+struct DistributedConfig {
+  int ranks = 4;
+  TransportType transport = TransportType::Local;
+  size_t count = 20000;
+  SceneType scene = SceneType::Disc;
+  unsigned int seed = 42;
+  int steps = 10;
+  float theta = BARNES_HUT_THETA;
+  // walk threads per rank; local ranks share one process and always use 1
+  int threadCount = 1;
+  bool check = false;
+};
+
+static void printUsage() {
+  std::cerr
+      << "usage: gravity_distributed [options]\n"
+         "  --ranks N         ranks for the local and socket transports\n"
+         "  --transport NAME  local | socket | mpi\n"
+         "  --n N             body count\n"
+         "  --scene NAME      disc | flat-disc | plummer\n"
+         "  --seed N          scene seed\n"
+         "  --steps N         time steps\n"
+         "  --theta X         Barnes-Hut opening angle\n"
+         "  --threads N       walk threads per rank (socket and mpi)\n"
+         "  --check 0|1       compare the final forces with a direct sum\n";
+}
+
+static bool parseArguments(int argc, char **argv, DistributedConfig &config) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+      return false;
+    if (i + 1 >= argc) {
+      std::cerr << "missing value for " << arg << "\n";
+      return false;
+    }
+    std::string value = argv[++i];
+
+    bool ok = true;
+    try {
+      if (arg == "--ranks")
+        config.ranks = std::max(1, std::stoi(value));
+      else if (arg == "--transport")
+        ok = parseTransportType(value, config.transport);
+      else if (arg == "--n")
+        config.count = std::stoul(value);
+      else if (arg == "--scene")
+        ok = parseSceneType(value, config.scene);
+      else if (arg == "--seed")
+        config.seed = std::stoul(value);
+      else if (arg == "--steps")
+        config.steps = std::max(0, std::stoi(value));
+      else if (arg == "--theta")
+        config.theta = std::stof(value);
+      else if (arg == "--threads")
+        config.threadCount = std::max(1, std::stoi(value));
+      else if (arg == "--check")
+        config.check = std::stoi(value) != 0;
+      else {
+        std::cerr << "unknown option " << arg << "\n";
+        return false;
+      }
+    } catch (const std::exception &) {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::cerr << "invalid value for " << arg << ": " << value << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// every rank's stats of the last step, on rank 0
+static bool gatherStats(Transport &transport, const DomainStats &own,
+                        std::vector<DomainStats> &all) {
+  std::vector<char> message(sizeof(DomainStats));
+  memcpy(message.data(), &own, sizeof(DomainStats));
+  std::vector<std::vector<char>> messages;
+  if (!allGather(transport, message, messages))
+    return false;
+  all.resize(messages.size());
+  for (size_t r = 0; r < messages.size(); r++)
+    memcpy(&all[r], messages[r].data(), sizeof(DomainStats));
+  return true;
+}
+
+static void printStep(int step, double stepMs,
+                      const std::vector<DomainStats> &all) {
+  size_t fewest = all[0].localBodies, most = 0, cells = 0, imported = 0;
+  size_t migrated = 0, bytes = 0;
+  double exchangeMs = 0.0, forceMs = 0.0;
+  for (const DomainStats &stats : all) {
+    fewest = std::min(fewest, stats.localBodies);
+    most = std::max(most, stats.localBodies);
+    cells += stats.importedCells;
+    imported += stats.importedBodies;
+    migrated += stats.migratedBodies;
+    bytes += stats.bytesSent;
+    exchangeMs = std::max(exchangeMs, stats.exchangeMs);
+    forceMs = std::max(forceMs, stats.forceMs);
+  }
+  std::cout << "step " << step << ": " << stepMs << " ms, bodies per rank "
+            << fewest << ".." << most << ", imported " << cells
+            << " cells and " << imported << " bodies, migrated " << migrated
+            << ", sent " << bytes / 1024 << " KiB, exchange " << exchangeMs
+            << " ms, forces " << forceMs << " ms\n";
+}
+
+static std::vector<double> relativeErrors(
+    const std::vector<CelestialBody> &bodies,
+    const std::vector<BasicCelestialBody<DoublePrecision>> &reference) {
+  std::vector<double> errors;
+  for (size_t i = 0; i < bodies.size(); i++) {
+    double referenceLength = glm::length(reference[i].acceleration);
+    if (bodies[i].isFixed() || referenceLength == 0.0)
+      continue;
+    errors.push_back(glm::length(glm::dvec3(bodies[i].acceleration) -
+                                 reference[i].acceleration) /
+                     referenceLength);
+  }
+  return errors;
+}
+
+// the distributed forces and a single-process walk at the same theta,
+// both against a double precision direct sum
+static void checkForces(const DistributedConfig &config,
+                        const std::vector<CelestialBody> &gathered) {
+  std::vector<BasicCelestialBody<DoublePrecision>> reference(gathered.begin(),
+                                                             gathered.end());
+  BasicDirectEngine<DoublePrecision> direct;
+  direct.threadCount = config.threadCount;
+  direct.computeAccelerations(reference, DISTRIBUTED_GRAVITATIONAL_CONSTANT);
+
+  std::vector<CelestialBody> single = gathered;
+  BarnesHutEngine barnesHut(config.theta);
+  barnesHut.threadCount = config.threadCount;
+  barnesHut.computeAccelerations(single, DISTRIBUTED_GRAVITATIONAL_CONSTANT);
+
+  std::vector<double> distributedErrors = relativeErrors(gathered, reference);
+  std::vector<double> singleErrors = relativeErrors(single, reference);
+  std::cout << "p99 relative force error vs direct: distributed "
+            << percentile(distributedErrors, 0.99) << ", single process "
+            << percentile(singleErrors, 0.99) << "\n";
+  std::cout << "max relative force error vs direct: distributed "
+            << percentile(distributedErrors, 1.0) << ", single process "
+            << percentile(singleErrors, 1.0) << "\n";
+}
+
+static bool runRank(Transport &transport, const DistributedConfig &config,
+                    int threadCount) {
+  std::vector<CelestialBody> scene;
+  if (transport.rank() == 0)
+    generateScene(scene, config.scene, config.count, config.seed,
+                  DISTRIBUTED_GRAVITATIONAL_CONSTANT);
+
+  DistributedSimulation simulation(
+      transport, DISTRIBUTED_GRAVITATIONAL_CONSTANT, config.theta);
+  simulation.engine.threadCount = threadCount;
+  if (!simulation.distribute(scene))
+    return false;
+
+  std::vector<DomainStats> all;
+  for (int step = 0; step < config.steps; step++) {
+    auto start = std::chrono::steady_clock::now();
+    if (!simulation.step(DISTRIBUTED_TIME_STEP))
+      return false;
+    double stepMs = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    if (!gatherStats(transport, simulation.stats(), all))
+      return false;
+    if (transport.rank() == 0)
+      printStep(step, stepMs, all);
+  }
+
+  if (!config.check)
+    return true;
+  std::vector<CelestialBody> gathered;
+  if (!simulation.computeForces() || !simulation.gather(gathered))
+    return false;
+  if (transport.rank() == 0)
+    checkForces(config, gathered);
+  return true;
+}
+
+// ranks as threads: the walks all go through the one task scheduler, so
+// each rank walks on its own thread only
+static bool runLocal(const DistributedConfig &config) {
+  TaskScheduler::instance().setThreadCount(1);
+  std::vector<std::unique_ptr<Transport>> transports =
+      LocalTransport::create(config.ranks);
+  std::vector<char> results(config.ranks, 0);
+  std::vector<std::thread> threads;
+  for (int rank = 1; rank < config.ranks; rank++)
+    threads.emplace_back([&, rank]() {
+      results[rank] = runRank(*transports[rank], config, 1);
+    });
+  results[0] = runRank(*transports[0], config, 1);
+  for (std::thread &thread : threads)
+    thread.join();
+  return std::all_of(results.begin(), results.end(),
+                     [](char ok) { return ok != 0; });
+}
+
+int main(int argc, char **argv) {
+  DistributedConfig config;
+  if (!parseArguments(argc, argv, config)) {
+    printUsage();
+    return 1;
+  }
+
+  switch (config.transport) {
+  case TransportType::Local:
+    return runLocal(config) ? 0 : 1;
+  case TransportType::Socket: {
+    // forks before any thread exists
+    std::unique_ptr<Transport> transport = SocketTransport::spawn(config.ranks);
+    if (transport == nullptr)
+      return 1;
+    bool ok = runRank(*transport, config, config.threadCount);
+    if (transport->rank() != 0) {
+      transport.reset();
+#if defined(__unix__) || defined(__APPLE__)
+      _exit(ok ? 0 : 1);
+#endif
+    }
+    transport.reset();
+    return ok ? 0 : 1;
+  }
+  case TransportType::Mpi: {
+#ifdef GRAVITY_WITH_MPI
+    MPI_Init(&argc, &argv);
+    bool ok;
+    {
+      MpiTransport transport;
+      ok = runRank(transport, config, config.threadCount);
+    }
+    MPI_Finalize();
+    return ok ? 0 : 1;
+#else
+    std::cerr << "built without MPI, configure with -DGRAVITY_WITH_MPI=ON\n";
+    return 1;
+#endif
+  }
+  }
+  return 1;
+}
@@ -0,0 +1,371 @@
+#include "include/domainDecomposition.h"
+#include "include/octreeNode.h"
+#include "include/profiler.h"
+#include "include/spatialSort.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <glm/geometric.hpp>
+#include <limits>
+#include <type_traits>
+
+template <typename T>
+static void pack(std::vector<char> &buffer, const std::vector<T> &values) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "only plain records travel between ranks");
+  size_t offset = buffer.size();
+  buffer.resize(offset + values.size() * sizeof(T));
+  if (!values.empty())
+    memcpy(buffer.data() + offset, values.data(), values.size() * sizeof(T));
+}
+
+// operator new memory is aligned for every type sent here
+template <typename T>
+static void unpack(const std::vector<char> &buffer, std::vector<T> &values) {
+  const T *first = reinterpret_cast<const T *>(buffer.data());
+  values.insert(values.end(), first, first + buffer.size() / sizeof(T));
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// min corner, max corner and whether the rank has any bodies at all
+struct DomainBox {
+  glm::vec3 min;
+  glm::vec3 max;
+  int occupied;
+};
+
+static DomainBox boundingBox(const std::vector<CelestialBody> &bodies) {
+  DomainBox box{glm::vec3(std::numeric_limits<float>::max()),
+                glm::vec3(std::numeric_limits<float>::lowest()), 0};
+  for (const CelestialBody &body : bodies) {
+    if (!body.isActive() || !std::isfinite(body.position.x) ||
+        !std::isfinite(body.position.y) || !std::isfinite(body.position.z))
+      continue;
+    box.min = glm::min(box.min, body.position);
+    box.max = glm::max(box.max, body.position);
+    box.occupied = 1;
+  }
+  return box;
+}
+
+static bool gatherBoxes(Transport &transport, const DomainBox &own,
+                        std::vector<DomainBox> &boxes) {
+  std::vector<char> message;
+  pack(message, std::vector<DomainBox>{own});
+  std::vector<std::vector<char>> messages;
+  if (!allGather(transport, message, messages))
+    return false;
+  boxes.clear();
+  for (const std::vector<char> &received : messages)
+    unpack(received, boxes);
+  return boxes.size() == (size_t)transport.size();
+}
+
+struct KeySample {
+  uint64_t key;
+  float cost;
+
+  bool operator<(const KeySample &other) const { return key < other.key; }
+};
+
+DistributedSimulation::DistributedSimulation(Transport &transport, float G,
+                                             float theta)
+    : G(G), theta(theta), transport(transport), keyMin(0.0f),
+      cellsPerUnit(0.0f), stepsSinceBalance(0) {
+  engine.collectBodyCounters = true;
+}
+
+uint64_t DistributedSimulation::keyOf(const CelestialBody &body) const {
+  return mortonKey(body.position, keyMin, cellsPerUnit);
+}
+
+int DistributedSimulation::ownerOf(uint64_t key) const {
+  return (int)(std::upper_bound(splitters.begin(), splitters.end(), key) -
+               splitters.begin());
+}
+
+bool DistributedSimulation::distribute(const std::vector<CelestialBody> &all) {
+  bodies.clear();
+  if (rank() == 0) {
+    bodies = all;
+    for (size_t i = 0; i < bodies.size(); i++) {
+      if (bodies[i].id == INVALID_BODY_ID)
+        bodies[i].id = i;
+    }
+  }
+  costs.assign(bodies.size(), 1.0f);
+  return rebalance() && migrate();
+}
+
+/**
+ *  Every rank sends cost-weighted samples of its sorted keys to everyone
+ *  and each rank picks the same splitters from the merged samples, so no
+ *  rank has to coordinate the choice.
+ * */
+bool DistributedSimulation::rebalance() {
+  PROFILE_SCOPE("domainRebalance");
+  int ranks = transport.size();
+  stepsSinceBalance = 0;
+
+  std::vector<DomainBox> boxes;
+  if (!gatherBoxes(transport, boundingBox(bodies), boxes))
+    return false;
+  glm::vec3 low(std::numeric_limits<float>::max());
+  glm::vec3 high(std::numeric_limits<float>::lowest());
+  for (const DomainBox &box : boxes) {
+    if (!box.occupied)
+      continue;
+    low = glm::min(low, box.min);
+    high = glm::max(high, box.max);
+  }
+  if (low.x > high.x) {
+    keyMin = glm::vec3(0.0f);
+    cellsPerUnit = 0.0f;
+  } else {
+    glm::vec3 extent = high - low;
+    float size = std::max(extent.x, std::max(extent.y, extent.z));
+    keyMin = low;
+    cellsPerUnit =
+        size > 0.0f ? (float)(1u << MORTON_BITS_PER_AXIS) / size : 0.0f;
+  }
+
+  std::vector<KeySample> keyed(bodies.size());
+  double localCost = 0.0;
+  for (size_t i = 0; i < bodies.size(); i++) {
+    keyed[i] = {keyOf(bodies[i]), costs[i]};
+    localCost += costs[i];
+  }
+  std::sort(keyed.begin(), keyed.end());
+
+  // the key where the cumulative cost crosses the middle of each of
+  // `count` equal cost slices, carrying that slice's cost
+  std::vector<KeySample> samples;
+  size_t count = std::min(keyed.size(), (size_t)DOMAIN_SAMPLES_PER_RANK);
+  double sliceCost = count > 0 ? localCost / count : 0.0;
+  double cumulative = 0.0;
+  size_t cursor = 0;
+  for (size_t k = 0; k < count; k++) {
+    double target = (k + 0.5) * sliceCost;
+    while (cursor + 1 < keyed.size() &&
+           cumulative + keyed[cursor].cost < target)
+      cumulative += keyed[cursor++].cost;
+    samples.push_back({keyed[cursor].key, (float)sliceCost});
+  }
+
+  std::vector<char> message;
+  pack(message, samples);
+  std::vector<std::vector<char>> messages;
+  if (!allGather(transport, message, messages))
+    return false;
+  samples.clear();
+  for (const std::vector<char> &received : messages)
+    unpack(received, samples);
+  std::sort(samples.begin(), samples.end());
+
+  double totalCost = 0.0;
+  for (const auto &sample : samples)
+    totalCost += sample.cost;
+
+  splitters.assign(ranks - 1, 0);
+  cumulative = 0.0;
+  cursor = 0;
+  for (int r = 1; r < ranks && !samples.empty(); r++) {
+    double target = totalCost * r / ranks;
+    while (cursor + 1 < samples.size() &&
+           cumulative + samples[cursor].cost < target)
+      cumulative += samples[cursor++].cost;
+    splitters[r - 1] = samples[cursor].key;
+  }
+  return true;
+}
+
+bool DistributedSimulation::migrate() {
+  PROFILE_SCOPE("domainMigrate");
+  int ranks = transport.size();
+  std::vector<std::vector<CelestialBody>> leaving(ranks);
+  std::vector<std::vector<float>> leavingCosts(ranks);
+
+  size_t kept = 0;
+  for (size_t i = 0; i < bodies.size(); i++) {
+    int owner = ownerOf(keyOf(bodies[i]));
+    if (owner == rank()) {
+      bodies[kept] = bodies[i];
+      costs[kept++] = costs[i];
+    } else {
+      leaving[owner].push_back(bodies[i]);
+      leavingCosts[owner].push_back(costs[i]);
+    }
+  }
+  lastStats.migratedBodies = bodies.size() - kept;
+  bodies.erase(bodies.begin() + kept, bodies.end());
+  costs.resize(kept);
+
+  std::vector<std::vector<char>> outgoing(ranks), incoming;
+  for (int r = 0; r < ranks; r++) {
+    pack(outgoing[r], leaving[r]);
+    lastStats.bytesSent += r == rank() ? 0 : outgoing[r].size();
+  }
+  if (!allToAll(transport, outgoing, incoming))
+    return false;
+  for (const std::vector<char> &received : incoming)
+    unpack(received, bodies);
+
+  for (int r = 0; r < ranks; r++) {
+    outgoing[r].clear();
+    pack(outgoing[r], leavingCosts[r]);
+  }
+  if (!allToAll(transport, outgoing, incoming))
+    return false;
+  for (const std::vector<char> &received : incoming)
+    unpack(received, costs);
+  lastStats.localBodies = bodies.size();
+  return costs.size() == bodies.size();
+}
+
+// the cell passes the opening criterion for every point of the box when it
+// passes for the point of the box nearest its centre of mass
+static bool acceptedForBox(const OctreeNode &node, const DomainBox &box,
+                           float theta) {
+  glm::vec3 nearest = glm::max(box.min, glm::min(node.centerOfMass, box.max));
+  float distance = glm::length(node.centerOfMass - nearest);
+  if (distance < 0.1f)
+    return false;
+  return node.size / distance < theta;
+}
+
+bool DistributedSimulation::exchangeEssential(
+    std::vector<CelestialBody> &imported) {
+  PROFILE_SCOPE("exchangeEssential");
+  int ranks = transport.size();
+  DomainBox own = boundingBox(bodies);
+  std::vector<DomainBox> boxes;
+  if (!gatherBoxes(transport, own, boxes))
+    return false;
+
+  std::vector<std::vector<CelestialBody>> exports(ranks);
+  if (own.occupied) {
+    std::vector<CelestialBody *> pointers;
+    for (CelestialBody &body : bodies) {
+      if (body.isActive() && std::isfinite(body.position.x) &&
+          std::isfinite(body.position.y) && std::isfinite(body.position.z))
+        pointers.push_back(&body);
+    }
+    glm::vec3 extent = own.max - own.min;
+    float size = std::max(extent.x, std::max(extent.y, extent.z)) * 1.01f + 1.0f;
+    OctreeLimits limits;
+    limits.leafCapacity = DOMAIN_EXPORT_LEAF_CAPACITY;
+    OctreeNode root((own.min + own.max) * 0.5f, size, 0, limits);
+    std::vector<CelestialBody *> scratch(pointers.size());
+    root.buildSubtree(pointers.data(), pointers.data() + pointers.size(),
+                      scratch.data());
+
+    std::vector<const OctreeNode *> stack;
+    for (int r = 0; r < ranks; r++) {
+      if (r == rank() || !boxes[r].occupied)
+        continue;
+      stack.assign(1, &root);
+      while (!stack.empty()) {
+        const OctreeNode *node = stack.back();
+        stack.pop_back();
+        if (node->totalMass == 0.0f)
+          continue;
+        if (node->isLeaf) {
+          // remote bodies are sources only, never integrated here
+          for (const CelestialBody *body : node->bodies) {
+            exports[r].push_back(*body);
+            exports[r].back().flags |= BODY_FLAG_FIXED;
+          }
+        } else if (acceptedForBox(*node, boxes[r], theta)) {
+          exports[r].push_back(CelestialBody(node->centerOfMass,
+                                             glm::vec3(0.0f), node->totalMass,
+                                             true));
+        } else {
+          for (int i = OctreeNode::CHILD_COUNT - 1; i >= 0; i--) {
+            if (node->children[i] != nullptr)
+              stack.push_back(node->children[i].get());
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<std::vector<char>> outgoing(ranks), incoming;
+  for (int r = 0; r < ranks; r++) {
+    pack(outgoing[r], exports[r]);
+    lastStats.bytesSent += outgoing[r].size();
+  }
+  if (!allToAll(transport, outgoing, incoming))
+    return false;
+
+  imported.clear();
+  for (const std::vector<char> &received : incoming)
+    unpack(received, imported);
+  lastStats.importedCells = 0;
+  for (const CelestialBody &body : imported)
+    lastStats.importedCells += body.id == INVALID_BODY_ID ? 1 : 0;
+  lastStats.importedBodies = imported.size() - lastStats.importedCells;
+  return true;
+}
+
+bool DistributedSimulation::computeForces() {
+  lastStats.bytesSent = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<CelestialBody> imported;
+  if (!exchangeEssential(imported))
+    return false;
+  lastStats.exchangeMs = millisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  std::vector<CelestialBody> work;
+  work.reserve(bodies.size() + imported.size());
+  work.insert(work.end(), bodies.begin(), bodies.end());
+  work.insert(work.end(), imported.begin(), imported.end());
+  engine.theta = theta;
+  engine.collectBodyCounters = true;
+  engine.computeAccelerations(work, G);
+
+  for (size_t i = 0; i < bodies.size(); i++) {
+    bodies[i].acceleration = work[i].acceleration;
+    costs[i] = std::max(1.0f, (float)engine.bodyCounters[i].interactions());
+  }
+  lastStats.forceMs = millisecondsSince(start);
+  lastStats.localBodies = bodies.size();
+  return true;
+}
+
+bool DistributedSimulation::step(float deltaTime) {
+  if (!computeForces())
+    return false;
+  integrateBodies(bodies, deltaTime);
+  if (++stepsSinceBalance >= DOMAIN_REBALANCE_INTERVAL && !rebalance())
+    return false;
+  return migrate();
+}
+
+bool DistributedSimulation::gather(std::vector<CelestialBody> &all) {
+  all.clear();
+  if (rank() != 0) {
+    std::vector<char> message;
+    pack(message, bodies);
+    return transport.send(0, message);
+  }
+
+  all = bodies;
+  for (int r = 1; r < transport.size(); r++) {
+    std::vector<char> message;
+    if (!transport.receive(r, message))
+      return false;
+    unpack(message, all);
+  }
+  std::sort(all.begin(), all.end(),
+            [](const CelestialBody &a, const CelestialBody &b) {
+              return a.id < b.id;
+            });
+  return true;
+}
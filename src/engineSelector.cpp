@@ -0,0 +1,188 @@
+#include "include/engineSelector.h"
+#include "include/profiler.h"
+#include <algorithm>
+#include <chrono>
+
+bool parseEngineChoice(const std::string &name, EngineChoice &choice) {
+  if (name == "auto")
+    choice = EngineChoice::Auto;
+  else if (name == "direct")
+    choice = EngineChoice::Direct;
+  else if (name == "barnes-hut")
+    choice = EngineChoice::BarnesHut;
+  else
+    return false;
+  return true;
+}
+
+const char *engineChoiceName(EngineChoice choice) {
+  switch (choice) {
+  case EngineChoice::Auto:
+    return "auto";
+  case EngineChoice::Direct:
+    return "direct";
+  case EngineChoice::BarnesHut:
+    return "barnes-hut";
+  }
+  return "unknown";
+}
+
+template <typename P>
+double estimateDirectStepMs(const std::vector<BasicCelestialBody<P>> &bodies,
+                            float G, int threads) {
+  size_t moving = 0;
+  for (const BasicCelestialBody<P> &body : bodies) {
+    if (body.isActive() && !body.isFixed())
+      moving++;
+  }
+  if (moving == 0)
+    return 0.0;
+
+  // every stride-th target through the engine's own tiled kernel, so a
+  // clustered scene is sampled across its clusters. They are swapped to
+  // the front of a copy, which keeps the same sources and takes the
+  // accelerations it writes
+  std::vector<BasicCelestialBody<P>> work = bodies;
+  size_t span = std::min(work.size(), (size_t)ENGINE_CALIBRATION_SAMPLES);
+  size_t stride = work.size() / span;
+  for (size_t k = 1; k < span; k++)
+    std::swap(work[k], work[k * stride]);
+  auto start = std::chrono::steady_clock::now();
+  size_t samples = sumDirectRange(work, 0, span, G, false);
+  auto end = std::chrono::steady_clock::now();
+  if (samples == 0)
+    return 0.0;
+
+  double sampleMs =
+      std::chrono::duration<double, std::milli>(end - start).count();
+  return sampleMs * moving / samples / std::max(1, threads);
+}
+
+// the engine in use keeps running unless the other one is predicted
+// ENGINE_SWITCH_MARGIN cheaper
+static bool prefersDirect(const EngineCosts &costs, bool usingDirect) {
+  return costs.direct <
+         costs.barnesHut * (usingDirect ? 1.0 + ENGINE_SWITCH_MARGIN
+                                        : 1.0 - ENGINE_SWITCH_MARGIN);
+}
+
+template <typename P>
+BasicAutoEngine<P>::BasicAutoEngine()
+    : choice(EngineChoice::Auto), tuningCache(nullptr), useDirect(false),
+      lastRun(&barnesHut), selectedCount(0), stepsSinceSelect(0) {}
+
+// direct or barnesHut, whichever useDirect asks for
+template <typename P>
+BasicGravityEngine<P> &BasicAutoEngine<P>::chosen() {
+  if (useDirect)
+    return direct;
+  return barnesHut;
+}
+
+template <typename P>
+size_t BasicAutoEngine<P>::memoryBytes() const {
+  return direct.memoryBytes() + barnesHut.memoryBytes();
+}
+
+template <typename P>
+void BasicAutoEngine<P>::permuteBodyData(const std::vector<size_t> &order) {
+  direct.permuteBodyData(order);
+  barnesHut.permuteBodyData(order);
+}
+
+template <typename P> void BasicAutoEngine<P>::resetBodyData(size_t slot) {
+  direct.resetBodyData(slot);
+  barnesHut.resetBodyData(slot);
+}
+
+template <typename P>
+void BasicAutoEngine<P>::computeAccelerations(std::vector<Body> &bodies,
+                                              float G) {
+  direct.threadCount = this->threadCount;
+  direct.deterministic = this->deterministic;
+  barnesHut.threadCount = this->threadCount;
+  barnesHut.deterministic = this->deterministic;
+
+  size_t activeCount = 0;
+  for (const Body &body : bodies)
+    activeCount += body.isActive() ? 1 : 0;
+
+  bool countChanged =
+      selectedCount == 0 ||
+      activeCount * ENGINE_SELECT_COUNT_RATIO < selectedCount ||
+      activeCount > selectedCount * ENGINE_SELECT_COUNT_RATIO;
+
+  if (choice != EngineChoice::Auto) {
+    useDirect = choice == EngineChoice::Direct;
+    // forcing an engine forgets the choice, going back to Auto chooses again
+    selectedCount = 0;
+    lastRun = &chosen();
+    lastRun->computeAccelerations(bodies, G);
+  } else if (countChanged || ++stepsSinceSelect >= ENGINE_SELECT_INTERVAL) {
+    select(bodies, G, activeCount, countChanged);
+  } else {
+    lastRun = &chosen();
+    lastRun->computeAccelerations(bodies, G);
+  }
+  this->lastCounters = lastRun->lastCounters;
+}
+
+template <typename P>
+void BasicAutoEngine<P>::select(std::vector<Body> &bodies, float G,
+                                size_t activeCount, bool countChanged) {
+  PROFILE_SCOPE("selectEngine");
+  selectedCount = std::max<size_t>(activeCount, 1);
+  stepsSinceSelect = 0;
+
+  // timings differ between runs, so deterministic mode must not use them
+  TuningProfile profile;
+  if (countChanged && !this->deterministic && tuningCache != nullptr &&
+      tuningCache->find(activeCount, profile) && profile.directStepMs > 0.0 &&
+      profile.stepMs > 0.0) {
+    lastCosts.direct = profile.directStepMs;
+    lastCosts.barnesHut = profile.stepMs;
+    lastCosts.cached = true;
+  } else {
+    auto start = std::chrono::steady_clock::now();
+    barnesHut.computeAccelerations(bodies, G);
+    auto end = std::chrono::steady_clock::now();
+    lastRun = &barnesHut;
+    lastCosts.cached = false;
+
+    if (this->deterministic) {
+      size_t moving = 0;
+      for (const Body &body : bodies)
+        moving += body.isActive() && !body.isFixed() ? 1 : 0;
+      lastCosts.direct = (double)moving * (activeCount - 1);
+      lastCosts.barnesHut = (double)barnesHut.lastCounters.interactions() *
+                            ENGINE_TREE_INTERACTION_COST;
+    } else {
+      lastCosts.direct = estimateDirectStepMs(
+          bodies, G, std::max(1, this->threadCount));
+      lastCosts.barnesHut =
+          std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // this step's accelerations are already done, the choice applies from
+    // the next one
+    useDirect = prefersDirect(lastCosts, useDirect);
+    return;
+  }
+
+  useDirect = prefersDirect(lastCosts, useDirect);
+  lastRun = &chosen();
+  lastRun->computeAccelerations(bodies, G);
+}
+
+template double estimateDirectStepMs(const std::vector<CelestialBody> &, float,
+                                     int);
+template double
+estimateDirectStepMs(const std::vector<BasicCelestialBody<DoublePrecision>> &,
+                     float, int);
+template double
+estimateDirectStepMs(const std::vector<BasicCelestialBody<MixedPrecision>> &,
+                     float, int);
+
+template class BasicAutoEngine<FloatPrecision>;
+template class BasicAutoEngine<DoublePrecision>;
+template class BasicAutoEngine<MixedPrecision>;
@@ -0,0 +1,144 @@
+#include "include/fixedPoint.h"
+#include "include/cpuFeatures.h"
+#include "include/spatialSort.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#define FIXED_POINT_STEPS 4294967296.0
+
+FixedPointFrame::FixedPointFrame()
+    : origin(-1000.0), unit(2000.0 / FIXED_POINT_STEPS) {}
+
+FixedPointFrame::FixedPointFrame(const glm::dvec3 &center, double size)
+    : origin(center - glm::dvec3(size * 0.5)), unit(size / FIXED_POINT_STEPS) {}
+
+FixedPointFrame FixedPointFrame::fit(const glm::dvec3 &boundsMin,
+                                     const glm::dvec3 &boundsMax) {
+  glm::dvec3 extent = boundsMax - boundsMin;
+  double largest = std::max(extent.x, std::max(extent.y, extent.z));
+
+  // a power of two keeps unit an exact binary fraction
+  double size = 1.0;
+  while (size < largest * FIXED_POINT_DOMAIN_MARGIN)
+    size *= 2.0;
+  return FixedPointFrame((boundsMin + boundsMax) * 0.5, size);
+}
+
+static uint32_t toSteps(double steps) {
+  if (!(steps > 0.0))
+    return 0;
+  if (steps >= FIXED_POINT_STEPS - 1.0)
+    return UINT32_MAX;
+  return (uint32_t)std::llround(steps);
+}
+
+FixedPosition FixedPointFrame::toFixed(const glm::dvec3 &position) const {
+  glm::dvec3 steps = (position - origin) / unit;
+  return {toSteps(steps.x), toSteps(steps.y), toSteps(steps.z)};
+}
+
+glm::dvec3 FixedPointFrame::toWorld(const FixedPosition &position) const {
+  return origin + glm::dvec3((double)position.x, (double)position.y,
+                             (double)position.z) *
+                      unit;
+}
+
+glm::dvec3 FixedPointFrame::offset(const FixedPosition &from,
+                                   const FixedPosition &to) const {
+  int64_t dx = (int64_t)to.x - (int64_t)from.x;
+  int64_t dy = (int64_t)to.y - (int64_t)from.y;
+  int64_t dz = (int64_t)to.z - (int64_t)from.z;
+  return glm::dvec3((double)dx, (double)dy, (double)dz) * unit;
+}
+
+glm::dvec3 FixedPointFrame::toLocal(const FixedPosition &position) const {
+  const uint32_t half = 1u << 31;
+  return offset({half, half, half}, position);
+}
+
+static bool advanceAxis(uint32_t &coordinate, double displacement,
+                        double unit) {
+  int64_t moved = (int64_t)coordinate + std::llround(displacement / unit);
+  if (moved < 0) {
+    coordinate = 0;
+    return false;
+  }
+  if (moved > (int64_t)UINT32_MAX) {
+    coordinate = UINT32_MAX;
+    return false;
+  }
+  coordinate = (uint32_t)moved;
+  return true;
+}
+
+bool FixedPointFrame::advance(FixedPosition &position,
+                              const glm::dvec3 &displacement) const {
+  bool inside = advanceAxis(position.x, displacement.x, unit);
+  inside = advanceAxis(position.y, displacement.y, unit) && inside;
+  inside = advanceAxis(position.z, displacement.z, unit) && inside;
+  return inside;
+}
+
+// the top MORTON_BITS_PER_AXIS bits of each coordinate
+uint64_t mortonKey(const FixedPosition &position) {
+  const int shift = 32 - MORTON_BITS_PER_AXIS;
+  return interleaveBits(position.x >> shift, position.y >> shift,
+                        position.z >> shift);
+}
+
+std::vector<size_t> mortonOrder(const std::vector<FixedPosition> &positions) {
+  std::vector<std::pair<uint64_t, size_t>> keys(positions.size());
+  dispatchKernel([&]() {
+    for (size_t i = 0; i < positions.size(); i++)
+      keys[i] = {mortonKey(positions[i]), i};
+  });
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<size_t> order(positions.size());
+  for (size_t i = 0; i < keys.size(); i++)
+    order[i] = keys[i].second;
+  return order;
+}
+
+template <typename P>
+size_t integrateFixedPoint(std::vector<BasicCelestialBody<P>> &bodies,
+                           std::vector<FixedPosition> &positions,
+                           const FixedPointFrame &frame, float deltaTime) {
+  using Vec3 = typename P::Vec3;
+  size_t clamped = 0;
+  dispatchKernel([&]() {
+    for (size_t i = 0; i < bodies.size(); i++) {
+      BasicCelestialBody<P> &body = bodies[i];
+      if (!body.isActive() || body.isFixed()) {
+        body.acceleration = typename P::Accum(0.0f);
+        continue;
+      }
+
+      double dt = deltaTime;
+      glm::dvec3 a(body.acceleration);
+      body.velocity += Vec3(a * dt);
+      glm::dvec3 displacement =
+          glm::dvec3(body.velocity) * dt + 0.5 * a * dt * dt;
+      if (!frame.advance(positions[i], displacement))
+        clamped++;
+
+      body.position = Vec3(frame.toLocal(positions[i]));
+      body.acceleration = typename P::Accum(0.0f);
+    }
+  });
+  return clamped;
+}
+
+template size_t
+integrateFixedPoint(std::vector<BasicCelestialBody<FloatPrecision>> &bodies,
+                    std::vector<FixedPosition> &positions,
+                    const FixedPointFrame &frame, float deltaTime);
+template size_t
+integrateFixedPoint(std::vector<BasicCelestialBody<DoublePrecision>> &bodies,
+                    std::vector<FixedPosition> &positions,
+                    const FixedPointFrame &frame, float deltaTime);
+template size_t
+integrateFixedPoint(std::vector<BasicCelestialBody<MixedPrecision>> &bodies,
+                    std::vector<FixedPosition> &positions,
+                    const FixedPointFrame &frame, float deltaTime);
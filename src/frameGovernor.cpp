@@ -0,0 +1,163 @@
+#include "include/frameGovernor.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+FrameGovernor::FrameGovernor(float budgetMs)
+    : budgetMs(budgetMs), enabled(true), primed(false), holdFrames(0) {
+  current = bestSettings();
+}
+
+FidelitySettings FrameGovernor::bestSettings() const {
+  FidelitySettings best;
+  best.theta = bounds.minTheta;
+  best.substeps = bounds.maxSubsteps;
+  best.trailInterval = bounds.minTrailInterval;
+  best.renderStride = bounds.minRenderStride;
+  return best;
+}
+
+void FrameGovernor::setEnabled(bool value) {
+  enabled = value;
+  reset();
+}
+
+void FrameGovernor::reset() {
+  current = bestSettings();
+  smoothed = FramePhases();
+  primed = false;
+  holdFrames = 0;
+}
+
+// where value sits between the cheap and the best end, 1 at the best
+static float knobPosition(double value, double best, double cheap) {
+  if (best == cheap)
+    return 1.0f;
+  return (float)std::min(1.0, std::max(0.0, (value - cheap) / (best - cheap)));
+}
+
+float FrameGovernor::fidelity() const {
+  // the intervals double per step, so they are compared on a log scale
+  float position =
+      knobPosition(current.theta, bounds.minTheta, bounds.maxTheta) +
+      knobPosition(current.substeps, bounds.maxSubsteps, bounds.minSubsteps) +
+      knobPosition(-std::log2(current.trailInterval),
+                   -std::log2(bounds.minTrailInterval),
+                   -std::log2(bounds.maxTrailInterval)) +
+      knobPosition(-std::log2(current.renderStride),
+                   -std::log2(bounds.minRenderStride),
+                   -std::log2(bounds.maxRenderStride));
+  return position / 4.0f;
+}
+
+bool FrameGovernor::recordFrame(const FramePhases &phases) {
+  if (!enabled)
+    return false;
+
+  if (!primed) {
+    smoothed = phases;
+    primed = true;
+  } else {
+    const double weight = GOVERNOR_SMOOTHING;
+    smoothed.physicsMs += weight * (phases.physicsMs - smoothed.physicsMs);
+    smoothed.trailMs += weight * (phases.trailMs - smoothed.trailMs);
+    smoothed.renderMs += weight * (phases.renderMs - smoothed.renderMs);
+  }
+
+  if (holdFrames > 0) {
+    holdFrames--;
+    return false;
+  }
+
+  bool changed = false;
+  if (smoothed.totalMs() > budgetMs)
+    changed = degrade();
+  else
+    changed = improve();
+
+  if (changed)
+    holdFrames = GOVERNOR_HOLD_FRAMES;
+  return changed;
+}
+
+// one knob moved one step, with the frame time it is predicted to save
+// (degrade) or cost (improve)
+struct FidelityChange {
+  double deltaMs;
+  FidelitySettings settings;
+};
+
+bool FrameGovernor::degrade() {
+  double physicsPerStep = smoothed.physicsMs / current.substeps;
+  std::vector<FidelityChange> changes;
+
+  FidelitySettings next = current;
+  if (current.substeps > bounds.minSubsteps) {
+    next.substeps--;
+    changes.push_back({physicsPerStep, next});
+    next = current;
+  }
+  if (current.theta + GOVERNOR_THETA_STEP <= bounds.maxTheta + 1e-4f) {
+    next.theta += GOVERNOR_THETA_STEP;
+    changes.push_back({smoothed.physicsMs * GOVERNOR_THETA_GAIN, next});
+    next = current;
+  }
+  if (current.trailInterval * 2 <= bounds.maxTrailInterval) {
+    next.trailInterval *= 2;
+    changes.push_back({smoothed.trailMs * 0.5, next});
+    next = current;
+  }
+  if (current.renderStride * 2 <= bounds.maxRenderStride) {
+    next.renderStride *= 2;
+    changes.push_back({smoothed.renderMs * 0.5, next});
+  }
+  if (changes.empty())
+    return false;
+
+  auto largest = std::max_element(
+      changes.begin(), changes.end(),
+      [](const FidelityChange &a, const FidelityChange &b) {
+        return a.deltaMs < b.deltaMs;
+      });
+  current = largest->settings;
+  return true;
+}
+
+bool FrameGovernor::improve() {
+  double physicsPerStep = smoothed.physicsMs / current.substeps;
+  std::vector<FidelityChange> changes;
+
+  FidelitySettings next = current;
+  if (current.theta - GOVERNOR_THETA_STEP >= bounds.minTheta - 1e-4f) {
+    next.theta = std::max(bounds.minTheta, next.theta - GOVERNOR_THETA_STEP);
+    changes.push_back({smoothed.physicsMs * GOVERNOR_THETA_GAIN, next});
+    next = current;
+  }
+  if (current.substeps < bounds.maxSubsteps) {
+    next.substeps++;
+    changes.push_back({physicsPerStep, next});
+    next = current;
+  }
+  if (current.renderStride / 2 >= bounds.minRenderStride) {
+    next.renderStride /= 2;
+    changes.push_back({smoothed.renderMs, next});
+    next = current;
+  }
+  if (current.trailInterval / 2 >= bounds.minTrailInterval) {
+    next.trailInterval /= 2;
+    changes.push_back({smoothed.trailMs, next});
+  }
+  if (changes.empty())
+    return false;
+
+  auto cheapest = std::min_element(
+      changes.begin(), changes.end(),
+      [](const FidelityChange &a, const FidelityChange &b) {
+        return a.deltaMs < b.deltaMs;
+      });
+  if (smoothed.totalMs() + cheapest->deltaMs >=
+      budgetMs * GOVERNOR_RECOVER_FRACTION)
+    return false;
+  current = cheapest->settings;
+  return true;
+}
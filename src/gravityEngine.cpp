@@ -0,0 +1,664 @@
+#include "include/gravityEngine.h"
+#include "include/cpuFeatures.h"
+#include "include/parallel.h"
+#include "include/profiler.h"
+#include "include/spatialSort.h"
+#include "include/taskScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <glm/geometric.hpp>
+#include <limits>
+#include <utility>
+
+bool parsePlanarMode(const std::string &name, PlanarMode &mode) {
+  if (name == "auto")
+    mode = PlanarMode::Auto;
+  else if (name == "off")
+    mode = PlanarMode::Off;
+  else if (name == "on")
+    mode = PlanarMode::On;
+  else
+    return false;
+  return true;
+}
+
+const char *planarModeName(PlanarMode mode) {
+  switch (mode) {
+  case PlanarMode::Auto:
+    return "auto";
+  case PlanarMode::Off:
+    return "off";
+  case PlanarMode::On:
+    return "on";
+  }
+  return "unknown";
+}
+
+template <typename P>
+BasicGravityEngine<P>::BasicGravityEngine()
+    : threadCount(hardwareThreadCount()), deterministic(false) {}
+
+// every body's position and mass as separate arrays, so a source tile is a
+// few contiguous runs the target loop reads with unit stride
+template <typename P> struct DirectSources {
+  using Real = typename P::Real;
+
+  std::vector<Real> x, y, z, mass;
+  std::vector<uint8_t> active;
+  // sources the kernel does not skip, removed pool slots left out
+  size_t activeCount;
+
+  explicit DirectSources(const std::vector<BasicCelestialBody<P>> &bodies)
+      : x(bodies.size()), y(bodies.size()), z(bodies.size()),
+        mass(bodies.size()), active(bodies.size()), activeCount(0) {
+    for (size_t i = 0; i < bodies.size(); i++) {
+      x[i] = bodies[i].position.x;
+      y[i] = bodies[i].position.y;
+      z[i] = bodies[i].position.z;
+      mass[i] = bodies[i].mass;
+      active[i] = bodies[i].isActive() ? 1 : 0;
+      activeCount += active[i];
+    }
+  }
+};
+
+/**
+ *  One register block of targets. Each target keeps DETERMINISTIC_LANES
+ *  partial sums, source j going to lane j % DETERMINISTIC_LANES, and the
+ *  lanes are reduced pairwise, so any vector width and tiling reproduces
+ *  the same sum. The default mode sums into lane 0 in source order.
+ * */
+template <typename P> struct DirectTargetBlock {
+  using Real = typename P::Real;
+  using AccumReal = typename P::Accum::value_type;
+
+  size_t index[DIRECT_TARGET_BLOCK];
+  Real x[DIRECT_TARGET_BLOCK], y[DIRECT_TARGET_BLOCK], z[DIRECT_TARGET_BLOCK];
+  Real mass[DIRECT_TARGET_BLOCK];
+  AccumReal ax[DETERMINISTIC_LANES][DIRECT_TARGET_BLOCK];
+  AccumReal ay[DETERMINISTIC_LANES][DIRECT_TARGET_BLOCK];
+  AccumReal az[DETERMINISTIC_LANES][DIRECT_TARGET_BLOCK];
+  int width;
+};
+
+// sources [begin, end) into every target of the block; the loop over the
+// targets is the one that vectorizes
+template <typename P, bool FixedLanes>
+static void sumSourceTile(DirectTargetBlock<P> &block,
+                          const DirectSources<P> &sources, size_t begin,
+                          size_t end, float G) {
+  using Kernel = typename P::Kernel;
+  using Real = typename P::Real;
+  using AccumReal = typename P::Accum::value_type;
+
+  for (size_t j = begin; j < end; j++) {
+    if (!sources.active[j])
+      continue;
+    int lane = FixedLanes ? (int)(j % DETERMINISTIC_LANES) : 0;
+    Real sx = sources.x[j], sy = sources.y[j], sz = sources.z[j];
+    Kernel sourceMass = Kernel(sources.mass[j]);
+    for (int t = 0; t < DIRECT_TARGET_BLOCK; t++) {
+      Kernel gx, gy, gz;
+      pairAcceleration(Kernel(sx - block.x[t]), Kernel(sy - block.y[t]),
+                       Kernel(sz - block.z[t]), Kernel(block.mass[t]),
+                       sourceMass, G, gx, gy, gz);
+      // a select rather than a branch, so the self pair's NaN is dropped
+      // without leaving the vector loop
+      bool self = block.index[t] == j;
+      AccumReal &ax = block.ax[lane][t];
+      AccumReal &ay = block.ay[lane][t];
+      AccumReal &az = block.az[lane][t];
+      ax = self ? ax : ax + AccumReal(gx);
+      ay = self ? ay : ay + AccumReal(gy);
+      az = self ? az : az + AccumReal(gz);
+    }
+  }
+}
+
+// accelerations of the targets in [first, last), returns how many were
+// computed
+template <typename P>
+static size_t sumTargetTile(std::vector<BasicCelestialBody<P>> &bodies,
+                            const DirectSources<P> &sources, size_t first,
+                            size_t last, float G, bool deterministic) {
+  using Accum = typename P::Accum;
+  using AccumReal = typename Accum::value_type;
+  constexpr int BLOCKS = DIRECT_TARGET_TILE / DIRECT_TARGET_BLOCK;
+
+  DirectTargetBlock<P> blocks[BLOCKS];
+  int blockCount = 0;
+  size_t targets = 0;
+  for (size_t i = first; i < last; i++) {
+    if (bodies[i].isFixed() || !bodies[i].isActive())
+      continue;
+    if (targets % DIRECT_TARGET_BLOCK == 0)
+      blocks[blockCount++].width = 0;
+    DirectTargetBlock<P> &block = blocks[blockCount - 1];
+    int t = block.width++;
+    block.index[t] = i;
+    block.x[t] = bodies[i].position.x;
+    block.y[t] = bodies[i].position.y;
+    block.z[t] = bodies[i].position.z;
+    block.mass[t] = bodies[i].mass;
+    targets++;
+  }
+  if (targets == 0)
+    return 0;
+
+  for (int b = 0; b < blockCount; b++) {
+    DirectTargetBlock<P> &block = blocks[b];
+    // padding lanes repeat the last target and are never stored
+    for (int t = block.width; t < DIRECT_TARGET_BLOCK; t++) {
+      block.index[t] = block.index[block.width - 1];
+      block.x[t] = block.x[block.width - 1];
+      block.y[t] = block.y[block.width - 1];
+      block.z[t] = block.z[block.width - 1];
+      block.mass[t] = block.mass[block.width - 1];
+    }
+    int lanes = deterministic ? DETERMINISTIC_LANES : 1;
+    for (int lane = 0; lane < lanes; lane++) {
+      for (int t = 0; t < DIRECT_TARGET_BLOCK; t++) {
+        block.ax[lane][t] = AccumReal(0.0f);
+        block.ay[lane][t] = AccumReal(0.0f);
+        block.az[lane][t] = AccumReal(0.0f);
+      }
+    }
+  }
+
+  size_t count = bodies.size();
+  for (size_t begin = 0; begin < count; begin += DIRECT_SOURCE_TILE) {
+    size_t end = std::min(count, begin + DIRECT_SOURCE_TILE);
+    for (int b = 0; b < blockCount; b++) {
+      if (deterministic)
+        sumSourceTile<P, true>(blocks[b], sources, begin, end, G);
+      else
+        sumSourceTile<P, false>(blocks[b], sources, begin, end, G);
+    }
+  }
+
+  for (int b = 0; b < blockCount; b++) {
+    DirectTargetBlock<P> &block = blocks[b];
+    for (int t = 0; t < block.width; t++) {
+      if (deterministic) {
+        for (int width = DETERMINISTIC_LANES / 2; width > 0; width /= 2) {
+          for (int lane = 0; lane < width; lane++) {
+            block.ax[lane][t] += block.ax[lane + width][t];
+            block.ay[lane][t] += block.ay[lane + width][t];
+            block.az[lane][t] += block.az[lane + width][t];
+          }
+        }
+      }
+      bodies[block.index[t]].acceleration =
+          Accum(block.ax[0][t], block.ay[0][t], block.az[0][t]);
+    }
+  }
+  return targets;
+}
+
+template <typename P>
+size_t sumDirectRange(std::vector<BasicCelestialBody<P>> &bodies,
+                      size_t first, size_t last, float G,
+                      bool deterministic) {
+  DirectSources<P> sources(bodies);
+  size_t targets = 0;
+  dispatchKernel([&]() {
+    for (size_t begin = first; begin < last; begin += DIRECT_TARGET_TILE) {
+      size_t end = std::min(last, begin + DIRECT_TARGET_TILE);
+      targets += sumTargetTile<P>(bodies, sources, begin, end, G,
+                                  deterministic);
+    }
+  });
+  return targets;
+}
+
+template <typename P>
+void BasicDirectEngine<P>::computeAccelerations(std::vector<Body> &bodies,
+                                                float G) {
+  size_t count = bodies.size();
+  int threads = std::max(1, this->threadCount);
+  TaskScheduler::instance().setThreadCount(threads);
+  std::vector<InteractionCounters> threadCounters(threads);
+  DirectSources<P> sources(bodies);
+  size_t tiles = (count + DIRECT_TARGET_TILE - 1) / DIRECT_TARGET_TILE;
+
+  parallelFor(0, tiles, threads, [&](size_t begin, size_t end, int thread) {
+    PROFILE_SCOPE("directForces");
+    InteractionCounters counters;
+    dispatchKernel([&]() {
+      for (size_t tile = begin; tile < end; tile++) {
+        size_t first = tile * DIRECT_TARGET_TILE;
+        size_t last = std::min(count, first + DIRECT_TARGET_TILE);
+        size_t targets = sumTargetTile<P>(bodies, sources, first, last, G,
+                                          this->deterministic);
+        // targets are all active, so each skips itself among the sources
+        counters.bodyBody += targets * (sources.activeCount - 1);
+      }
+    });
+    threadCounters[thread] = counters;
+  });
+
+  this->lastCounters = InteractionCounters();
+  for (const InteractionCounters &counters : threadCounters)
+    this->lastCounters += counters;
+}
+
+template <typename P>
+BasicBarnesHutEngine<P>::BasicBarnesHutEngine(float theta, int leafCapacity,
+                                              int expansionOrder)
+    : theta(theta), leafCapacity(leafCapacity),
+      expansionOrder(expansionOrder), maxDepth(OCTREE_MAX_DEPTH),
+      minSize(OCTREE_MIN_SIZE), collectBodyCounters(false),
+      useCostZones(true), planarMode(PlanarMode::Auto),
+      nodeLayout(BARNES_HUT_NODE_LAYOUT),
+      openingCriterion(OpeningCriterion::Geometric),
+      forceAccuracy(BARNES_HUT_FORCE_ACCURACY), planar(false),
+      spaceMin(-1000.0f), spaceMax(1000.0f) {}
+
+template <typename Vec3> static bool isFinite(const Vec3 &v) {
+  return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+}
+
+template <typename Real> static Real medianOf(std::vector<Real> &values) {
+  auto middle = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), middle, values.end());
+  return *middle;
+}
+
+/**
+ *  Escapers are judged against the median position and a distance quantile,
+ *  neither of which a few ejected bodies can drag along. Only the furthest
+ *  ESCAPER_MAX_COUNT candidates are split off so the direct sums they need
+ *  stay a small fixed cost per body.
+ * */
+template <typename P>
+void BasicBarnesHutEngine<P>::findEscapers(const std::vector<Body> &bodies,
+                                           int threads) {
+  using Real = typename P::Real;
+  escapers.clear();
+  isEscaper.assign(bodies.size(), 0);
+
+  std::vector<size_t> candidates;
+  candidates.reserve(bodies.size());
+  for (size_t i = 0; i < bodies.size(); i++) {
+    if (bodies[i].isActive() && isFinite(bodies[i].position))
+      candidates.push_back(i);
+  }
+  if (candidates.size() < 2)
+    return;
+
+  Vec3 median;
+  std::vector<Real> values(candidates.size());
+  for (int axis = 0; axis < 3; axis++) {
+    for (size_t k = 0; k < candidates.size(); k++)
+      values[k] = bodies[candidates[k]].position[axis];
+    median[axis] = medianOf(values);
+  }
+
+  std::vector<Real> distances(candidates.size());
+  parallelFor(0, candidates.size(), threads,
+              [&](size_t begin, size_t end, int) {
+                for (size_t k = begin; k < end; k++)
+                  distances[k] = glm::length(
+                      bodies[candidates[k]].position - median);
+              });
+
+  values = distances;
+  auto quantile =
+      values.begin() + (size_t)(ESCAPER_QUANTILE * (values.size() - 1));
+  std::nth_element(values.begin(), quantile, values.end());
+  Real cutoff = *quantile * ESCAPER_RADIUS_FACTOR;
+  if (cutoff <= 0.0f)
+    return;
+
+  std::vector<std::pair<Real, size_t>> far;
+  for (size_t k = 0; k < candidates.size(); k++) {
+    if (distances[k] > cutoff)
+      far.push_back({distances[k], candidates[k]});
+  }
+  if (far.size() > ESCAPER_MAX_COUNT) {
+    std::nth_element(far.begin(), far.begin() + ESCAPER_MAX_COUNT, far.end(),
+                     std::greater<std::pair<Real, size_t>>());
+    far.resize(ESCAPER_MAX_COUNT);
+  }
+
+  // storage order, so the direct sums run in the same order every time
+  for (const auto &entry : far)
+    escapers.push_back(entry.second);
+  std::sort(escapers.begin(), escapers.end());
+  for (size_t i : escapers)
+    isEscaper[i] = 1;
+}
+
+// smallest power-of-two cube, centred on a multiple of half its size, that
+// holds [boundsMin, boundsMax]; slowly moving bodies keep the same root box
+template <typename Vec3, typename Real>
+static void snapRootCube(const Vec3 &boundsMin, const Vec3 &boundsMax,
+                         Vec3 &center, Real &size) {
+  Vec3 extent = boundsMax - boundsMin;
+  Real largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+  Vec3 middle = (boundsMin + boundsMax) * Real(0.5f);
+
+  size = OCTREE_MIN_ROOT_SIZE;
+  while (size <= largest)
+    size *= 2.0f;
+
+  while (std::isfinite(size)) {
+    Real half = size * Real(0.5f);
+    bool fits = true;
+    for (int axis = 0; axis < 3; axis++) {
+      center[axis] = std::round(middle[axis] / half) * half;
+      // the upper faces are open, see OctreeNode::contains
+      fits = fits && boundsMin[axis] >= center[axis] - half &&
+             boundsMax[axis] < center[axis] + half;
+    }
+    if (fits)
+      return;
+    size *= 2.0f;
+  }
+  center = middle;
+}
+
+template <typename P>
+void BasicBarnesHutEngine<P>::calculateBounds(const std::vector<Body> &bodies,
+                                              int threads) {
+  using Real = typename P::Real;
+  PROFILE_SCOPE("calculateBounds");
+  findEscapers(bodies, threads);
+
+  std::vector<Vec3> chunkMin(threads, Vec3(std::numeric_limits<Real>::max()));
+  std::vector<Vec3> chunkMax(threads,
+                             Vec3(std::numeric_limits<Real>::lowest()));
+  parallelFor(0, bodies.size(), threads,
+              [&](size_t begin, size_t end, int chunk) {
+                Vec3 low = chunkMin[chunk];
+                Vec3 high = chunkMax[chunk];
+                for (size_t i = begin; i < end; i++) {
+                  const Body &body = bodies[i];
+                  if (!body.isActive() || isEscaper[i] ||
+                      !isFinite(body.position))
+                    continue;
+                  low = glm::min(low, body.position);
+                  high = glm::max(high, body.position);
+                }
+                chunkMin[chunk] = low;
+                chunkMax[chunk] = high;
+              });
+
+  spaceMin = Vec3(std::numeric_limits<Real>::max());
+  spaceMax = Vec3(std::numeric_limits<Real>::lowest());
+  for (int chunk = 0; chunk < threads; chunk++) {
+    spaceMin = glm::min(spaceMin, chunkMin[chunk]);
+    spaceMax = glm::max(spaceMax, chunkMax[chunk]);
+  }
+
+  if (spaceMin.x > spaceMax.x) {
+    planar = planarMode == PlanarMode::On;
+    spaceMin = Vec3(-OCTREE_MIN_ROOT_SIZE * 0.5f);
+    spaceMax = Vec3(OCTREE_MIN_ROOT_SIZE * 0.5f);
+    return;
+  }
+
+  Vec3 extent = spaceMax - spaceMin;
+  planar = planarMode == PlanarMode::On ||
+           (planarMode == PlanarMode::Auto &&
+            extent.y <= Real(PLANAR_THICKNESS_RATIO) *
+                            glm::max(extent.x, extent.z));
+
+  Vec3 padding = (spaceMax - spaceMin) * Real(OCTREE_ROOT_PADDING);
+  spaceMin -= padding;
+  spaceMax += padding;
+
+  Vec3 center;
+  Real size;
+  snapRootCube(spaceMin, spaceMax, center, size);
+  spaceMin = center - Vec3(size * Real(0.5f));
+  spaceMax = center + Vec3(size * Real(0.5f));
+}
+
+template <typename P>
+template <typename Node>
+void BasicBarnesHutEngine<P>::buildTree(std::unique_ptr<Node> &treeRoot,
+                                        std::vector<Body> &bodies) {
+  Vec3 center = (spaceMin + spaceMax) * typename P::Real(0.5f);
+  typename P::Real size = spaceMax.x - spaceMin.x;
+  OctreeLimits limits;
+  limits.leafCapacity = leafCapacity;
+  limits.maxDepth = maxDepth;
+  limits.minSize = minSize;
+  treeRoot = std::make_unique<Node>(Node::project(center), size, 0, limits);
+
+  std::vector<Body *> contained;
+  contained.reserve(bodies.size());
+  for (size_t i = 0; i < bodies.size(); i++) {
+    Body &body = bodies[i];
+    if (!body.isActive() || isEscaper[i])
+      continue;
+    if (treeRoot->contains(Node::project(body.position)))
+      contained.push_back(&body);
+    else
+      body.acceleration = typename P::Accum(0.0f); // e.g. non-finite position
+  }
+
+  std::vector<Body *> scratch(contained.size());
+  treeRoot->buildSubtree(contained.data(), contained.data() + contained.size(),
+                         scratch.data());
+}
+
+template <typename P>
+void BasicBarnesHutEngine<P>::buildOctree(std::vector<Body> &bodies) {
+  calculateBounds(bodies, std::max(1, this->threadCount));
+
+  {
+    PROFILE_SCOPE("buildOctree");
+    if (planar) {
+      octreeRoot.reset();
+      buildTree(quadtreeRoot, bodies);
+    } else {
+      quadtreeRoot.reset();
+      buildTree(octreeRoot, bodies);
+    }
+  }
+
+  PROFILE_SCOPE("linearizeTree");
+  linearOctree.clear();
+  linearQuadtree.clear();
+  if (nodeLayout == NodeLayout::Pointer)
+    return;
+  if (planar)
+    linearQuadtree.build(*quadtreeRoot, nodeLayout);
+  else
+    linearOctree.build(*octreeRoot, nodeLayout);
+}
+
+// tree bodies in walk order followed by the escapers; buildOctree already
+// reset the acceleration of the bodies it could not place
+template <typename P>
+void BasicBarnesHutEngine<P>::updateTreeOrder(const std::vector<Body> &bodies) {
+  std::vector<Body *> ordered;
+  ordered.reserve(bodies.size());
+  if (planar)
+    quadtreeRoot->collectBodies(ordered);
+  else
+    octreeRoot->collectBodies(ordered);
+
+  treeOrder.clear();
+  treeOrder.reserve(ordered.size() + escapers.size());
+  for (const Body *body : ordered)
+    treeOrder.push_back(body - bodies.data());
+  treeOrder.insert(treeOrder.end(), escapers.begin(), escapers.end());
+}
+
+template <typename P>
+std::vector<size_t>
+BasicBarnesHutEngine<P>::costZoneBoundaries(int zones) const {
+  size_t count = treeOrder.size();
+  std::vector<size_t> boundaries(zones + 1, count);
+  boundaries[0] = 0;
+
+  double totalCost = 0.0;
+  for (size_t index : treeOrder)
+    totalCost += bodyCosts[index];
+
+  double cost = 0.0;
+  int zone = 1;
+  for (size_t k = 0; k < count && zone < zones; k++) {
+    cost += bodyCosts[treeOrder[k]];
+    while (zone < zones && cost >= totalCost * zone / zones)
+      boundaries[zone++] = k + 1;
+  }
+  return boundaries;
+}
+
+template <typename P>
+void BasicBarnesHutEngine<P>::computeAccelerations(std::vector<Body> &bodies,
+                                                   float G) {
+  int threads = std::max(1, this->threadCount);
+  TaskScheduler::instance().setThreadCount(threads);
+
+  buildOctree(bodies);
+  updateTreeOrder(bodies);
+
+  growBodyData(bodies.size());
+  bodyCosts.resize(bodies.size());
+  previousAccelerations.resize(bodies.size());
+
+  // several cost zones per thread so stealing can even out misestimates
+  int zones = threads > 1 ? threads * BARNES_HUT_ZONES_PER_THREAD : 1;
+  std::vector<InteractionCounters> zoneCounters(zones);
+  if (collectBodyCounters)
+    bodyCounters.assign(bodies.size(), InteractionCounters());
+
+  auto walk = [&](size_t begin, size_t end, int zone) {
+    PROFILE_SCOPE("barnesHutForces");
+    InteractionCounters counters;
+    for (size_t k = begin; k < end; k++) {
+      size_t i = treeOrder[k];
+      Body &body = bodies[i];
+      if (body.isFixed()) {
+        bodyCosts[i] = 0.0f;
+        continue;
+      }
+
+      // one task walks each target, children always in octant order, so
+      // the sum order is already fixed in deterministic mode
+      InteractionCounters bodyCounter;
+      OpeningTest opening;
+      opening.criterion = openingCriterion;
+      opening.theta = theta;
+      // like Gadget, a body's first step is bounded by theta alone
+      if (openingCriterion == OpeningCriterion::Relative) {
+        if (previousAccelerations[i] > 0.0f)
+          opening.limit = (double)forceAccuracy * previousAccelerations[i] / G;
+        else
+          opening.criterion = OpeningCriterion::Geometric;
+      }
+      body.acceleration = typename P::Accum(0.0f);
+      if (nodeLayout != NodeLayout::Pointer && planar)
+        linearQuadtree.calculateForce(body, G, bodyCounter, opening,
+                                      expansionOrder);
+      else if (nodeLayout != NodeLayout::Pointer)
+        linearOctree.calculateForce(body, G, bodyCounter, opening,
+                                    expansionOrder);
+      else if (planar)
+        quadtreeRoot->calculateForce(body, G, bodyCounter, opening,
+                                     expansionOrder);
+      else
+        octreeRoot->calculateForce(body, G, bodyCounter, opening,
+                                   expansionOrder);
+      for (size_t j : escapers) {
+        if (j != i) {
+          body.applyGravity(bodies[j], G);
+          bodyCounter.bodyBody++;
+        }
+      }
+      counters += bodyCounter;
+      bodyCosts[i] = (float)(bodyCounter.interactions() +
+                             bodyCounter.nodesOpened);
+      previousAccelerations[i] = (float)glm::length(body.acceleration);
+      if (collectBodyCounters)
+        bodyCounters[i] = bodyCounter;
+    }
+    zoneCounters[zone] = counters;
+  };
+
+  if (useCostZones && zones > 1)
+    parallelForRanges(costZoneBoundaries(zones), walk);
+  else
+    parallelFor(0, treeOrder.size(), zones, walk);
+
+  this->lastCounters = InteractionCounters();
+  for (const InteractionCounters &counters : zoneCounters)
+    this->lastCounters += counters;
+}
+
+template <typename P> size_t BasicBarnesHutEngine<P>::memoryBytes() const {
+  size_t linear = linearOctree.memoryBytes() + linearQuadtree.memoryBytes();
+  if (quadtreeRoot)
+    return quadtreeRoot->memoryBytes() + linear;
+  return (octreeRoot ? octreeRoot->memoryBytes() : 0) + linear;
+}
+
+template <typename P>
+void BasicBarnesHutEngine<P>::permuteBodyData(
+    const std::vector<size_t> &order) {
+  // bodies added since the last step are in the order but not yet here
+  size_t count = 0;
+  for (size_t oldIndex : order)
+    count = std::max(count, oldIndex + 1);
+  growBodyData(count);
+
+  applyPermutation(bodyCosts, order);
+  applyPermutation(previousAccelerations, order);
+  applyPermutation(bodyCounters, order);
+}
+
+template <typename P>
+void BasicBarnesHutEngine<P>::resetBodyData(size_t slot) {
+  if (slot < bodyCosts.size())
+    bodyCosts[slot] = 1.0f;
+  if (slot < previousAccelerations.size())
+    previousAccelerations[slot] = 0.0f;
+}
+
+// bodies added since the last step start at unit cost and without a
+// previous acceleration for the Relative criterion, the others keep theirs
+template <typename P>
+void BasicBarnesHutEngine<P>::growBodyData(size_t count) {
+  if (bodyCosts.size() < count)
+    bodyCosts.resize(count, 1.0f);
+  if (previousAccelerations.size() < count)
+    previousAccelerations.resize(count, 0.0f);
+  if (!bodyCounters.empty() && bodyCounters.size() < count)
+    bodyCounters.resize(count);
+}
+
+template <typename P> OctreeStats BasicBarnesHutEngine<P>::treeStats() const {
+  OctreeStats stats;
+  if (quadtreeRoot) {
+    quadtreeRoot->collectStats(stats);
+    stats.dimensions = 2;
+  } else if (octreeRoot) {
+    octreeRoot->collectStats(stats);
+  }
+  stats.escaperCount = escapers.size();
+  return stats;
+}
+
+template class BasicGravityEngine<FloatPrecision>;
+template class BasicGravityEngine<DoublePrecision>;
+template class BasicGravityEngine<MixedPrecision>;
+template size_t sumDirectRange(std::vector<CelestialBody> &, size_t, size_t,
+                               float, bool);
+template size_t
+sumDirectRange(std::vector<BasicCelestialBody<DoublePrecision>> &, size_t,
+               size_t, float, bool);
+template size_t
+sumDirectRange(std::vector<BasicCelestialBody<MixedPrecision>> &, size_t,
+               size_t, float, bool);
+template class BasicDirectEngine<FloatPrecision>;
+template class BasicDirectEngine<DoublePrecision>;
+template class BasicDirectEngine<MixedPrecision>;
+template class BasicBarnesHutEngine<FloatPrecision>;
+template class BasicBarnesHutEngine<DoublePrecision>;
+template class BasicBarnesHutEngine<MixedPrecision>;
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "celestialBody.h"
+#include "gravityEngine.h"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// largest 99th percentile relative force error against the direct sum a
+// tuned profile may have
+#define AUTOTUNE_MAX_ERROR 0.01f
+// bodies the direct-sum reference is computed for
+#define AUTOTUNE_SAMPLE_COUNT 256
+// timed force computations per candidate, the fastest counts
+#define AUTOTUNE_REPEATS 2
+#define TUNING_CACHE_ENV "GRAVITY_TUNING_CACHE"
+#define TUNING_CACHE_FILE "gravity_sim/tuning.txt"
+
+// Barnes-Hut settings for one machine and scene size
+struct TuningProfile {
+  float theta = BARNES_HUT_THETA;
+  int leafCapacity = OCTREE_LEAF_CAPACITY;
+  int expansionOrder = BARNES_HUT_EXPANSION_ORDER;
+  int maxDepth = OCTREE_MAX_DEPTH;
+  float minSize = OCTREE_MIN_SIZE;
+  int threadCount = 1;
+  // what the tuner measured for this profile
+  double stepMs = 0.0;
+  double p99Error = 0.0;
+  // estimated direct-sum step at threadCount, 0 when unknown
+  double directStepMs = 0.0;
+
+  void applyTo(BarnesHutEngine &engine) const;
+};
+
+struct AutoTuneOptions {
+  float maxError = AUTOTUNE_MAX_ERROR;
+  std::vector<float> thetas{0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f, 1.0f};
+  std::vector<int> expansionOrders{0, 2};
+  std::vector<int> leafCapacities{1, 4, 8, 16};
+  std::vector<int> maxDepths{OCTREE_MAX_DEPTH, 16};
+  // empty: powers of two up to the hardware thread count
+  std::vector<int> threadCounts;
+};
+
+/**
+ *  Picks the cheapest Barnes-Hut profile for these bodies whose force error
+ *  stays under options.maxError: the largest passing theta per expansion
+ *  order first, then leaf capacity and depth, then the thread count. The
+ *  bodies are copied, the caller's are left alone.
+ * */
+TuningProfile autoTune(const std::vector<CelestialBody> &bodies, float G,
+                       const AutoTuneOptions &options = AutoTuneOptions());
+
+/**
+ *  Tuned profiles keyed by machine and by body count rounded to a power of
+ *  two, in a text file that several machines can share (e.g. a home
+ *  directory on a cluster).
+ * */
+class TuningCache {
+public:
+  explicit TuningCache(const std::string &path = defaultPath());
+
+  // $GRAVITY_TUNING_CACHE, else under $XDG_CACHE_HOME or ~/.cache
+  static std::string defaultPath();
+  // host name, hardware threads and ISA level
+  static std::string machineKey();
+
+  bool load();
+  bool save() const;
+  bool find(size_t bodyCount, TuningProfile &profile) const;
+  void store(size_t bodyCount, const TuningProfile &profile);
+  const std::string &filePath() const { return path; }
+
+private:
+  std::string path;
+  std::map<std::pair<std::string, int>, TuningProfile> profiles;
+};
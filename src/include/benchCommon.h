@@ -0,0 +1,47 @@
+#pragma once
+
+#include "precision.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// helpers shared by the command-line tools
+
+template <typename T>
+bool parseList(const std::string &text, std::vector<T> &values) {
+  values.clear();
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    std::stringstream itemStream(item);
+    T value;
+    if (!(itemStream >> value))
+      return false;
+    values.push_back(value);
+  }
+  return !values.empty();
+}
+
+inline bool parsePrecisionList(const std::string &text,
+                               std::vector<PrecisionMode> &modes) {
+  std::vector<std::string> names;
+  if (!parseList(text, names))
+    return false;
+  modes.clear();
+  for (const std::string &name : names) {
+    PrecisionMode mode;
+    if (!parsePrecisionMode(name, mode))
+      return false;
+    modes.push_back(mode);
+  }
+  return true;
+}
+
+inline double percentile(std::vector<double> values, double fraction) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)];
+}
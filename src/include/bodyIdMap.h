@@ -0,0 +1,29 @@
+#pragma once
+
+#include "celestialBody.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define INVALID_BODY_SLOT SIZE_MAX
+
+// dense id -> slot table; ids are handed out sequentially so the table is a
+// plain vector indexed by id, and removed ids just leave an invalid entry
+class BodyIdMap {
+public:
+  BodyIdMap();
+
+  void clear();
+  uint64_t insert(CelestialBody &body, size_t slot);
+  void erase(uint64_t id);
+  void moveSlot(uint64_t id, size_t slot);
+  // re-reads every body's slot after the array was permuted or compacted
+  void rebuild(const std::vector<CelestialBody> &bodies);
+
+  size_t slotOf(uint64_t id) const;
+  bool contains(uint64_t id) const { return slotOf(id) != INVALID_BODY_SLOT; }
+  uint64_t nextId() const { return slots.size(); }
+
+private:
+  std::vector<size_t> slots;
+};
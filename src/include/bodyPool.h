@@ -0,0 +1,46 @@
+#pragma once
+
+#include "bodyIdMap.h"
+#include "celestialBody.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// compact once this fraction of the slots are free
+#define BODY_COMPACTION_FRACTION 0.25f
+
+/**
+ *  Body array that grows and shrinks at runtime without reallocating.
+ *  Removed bodies leave an inactive slot on a free list that the next
+ *  insertion reuses; the holes are squeezed out in one batched pass by
+ *  compact() once enough of them pile up.
+ * */
+class BodyPool {
+public:
+  std::vector<CelestialBody> bodies;
+  // cold attributes, visuals[i] belongs to bodies[i]
+  std::vector<BodyVisual> visuals;
+  BodyIdMap ids;
+
+  BodyPool();
+
+  void clear();
+  uint64_t add(const CelestialBody &body,
+               const BodyVisual &visual = BodyVisual());
+  bool remove(uint64_t id);
+  // removes every non-fixed body further than radius from center
+  size_t removeBeyond(const glm::vec3 &center, float radius);
+
+  size_t activeCount() const { return bodies.size() - freeSlots.size(); }
+  size_t freeCount() const { return freeSlots.size(); }
+  bool needsCompaction() const;
+  // moves the live bodies down over the holes, keeping their order;
+  // returns order[newIndex] == oldIndex for per-body engine data
+  std::vector<size_t> compact();
+  // reorders both arrays after compact(), order[newIndex] == oldIndex
+  void permute(const std::vector<size_t> &order);
+
+private:
+  std::vector<size_t> freeSlots;
+};
@@ -1,27 +1,129 @@
 #pragma once
 
+#include "precision.h"
+#include <cmath>
+#include <cstdint>
 #include <deque>
+#include <glm/geometric.hpp>
 #include <glm/glm.hpp>
+#include <vector>
 
-class CelestialBody {
+#define INVALID_BODY_ID UINT64_MAX
+
+#define BODY_FLAG_FIXED 0x1u
+// cleared for a removed body whose slot waits on BodyPool's free list
+#define BODY_FLAG_ACTIVE 0x2u
+
+/**
+ *  Hot per-body record, everything the engines and the integrator touch.
+ *  Render attributes and trails live in BodyVisual, a parallel array that
+ *  only the viewer reads, so a float body is 56 bytes instead of ~150.
+ * */
+template <typename P> class BasicCelestialBody {
+public:
+  using Real = typename P::Real;
+  using Vec3 = typename P::Vec3;
+  using Accum = typename P::Accum;
+
+  Vec3 position;
+  Vec3 velocity;
+  Accum acceleration;
+  Real mass;
+  uint32_t flags;
+  // stable across reorders and removals, assigned by BodyIdMap
+  uint64_t id;
+
+  BasicCelestialBody(Vec3 pos, Vec3 vel, Real m, bool fixed = false);
+
+  // the same body at another precision
+  template <typename Q>
+  explicit BasicCelestialBody(const BasicCelestialBody<Q> &other)
+      : position(other.position), velocity(other.velocity),
+        acceleration(other.acceleration), mass(other.mass),
+        flags(other.flags), id(other.id) {}
+
+  bool isFixed() const { return flags & BODY_FLAG_FIXED; }
+  bool isActive() const { return flags & BODY_FLAG_ACTIVE; }
+  void setActive(bool active);
+
+  void applyGravity(const BasicCelestialBody &other, float G);
+  Accum gravityFrom(const BasicCelestialBody &other, float G) const;
+  void update(float deltaTime);
+};
+
+// the pair kernel lives here so the ISA-specific walks and direct sums
+// can inline it
+template <typename P>
+void BasicCelestialBody<P>::applyGravity(const BasicCelestialBody &other,
+                                         float G) {
+  if (&other == this)
+    return;
+
+  acceleration += gravityFrom(other, G);
+}
+
+/**
+ *  The pair kernel on separate components, so the tiled direct sum can run
+ *  it across a vector of targets and still give gravityFrom's bits.
+ *  (dx, dy, dz) is the offset from the target to the source.
+ * */
+template <typename Kernel>
+inline void pairAcceleration(Kernel dx, Kernel dy, Kernel dz,
+                             Kernel targetMass, Kernel sourceMass, float G,
+                             Kernel &ax, Kernel &ay, Kernel &az) {
+  Kernel length = std::sqrt(dx * dx + dy * dy + dz * dz);
+  Kernel distance = length < Kernel(0.1f) ? Kernel(0.1f) : length;
+
+  // gravitational force : F = G * m1 * m2 / r^2
+  Kernel forceMagnitude =
+      Kernel(G) * targetMass * sourceMass / (distance * distance);
+
+  // F = ma, along the unit offset
+  Kernel scale = forceMagnitude / targetMass;
+  Kernel inverseLength = Kernel(1.0f) / length;
+  ax = dx * inverseLength * scale;
+  ay = dy * inverseLength * scale;
+  az = dz * inverseLength * scale;
+}
+
+template <typename P>
+typename P::Accum
+BasicCelestialBody<P>::gravityFrom(const BasicCelestialBody &other,
+                                   float G) const {
+  using Kernel = typename P::Kernel;
+  using AccumReal = typename Accum::value_type;
+
+  // only the offset drops to kernel precision, never the positions
+  Vec3 offset = other.position - position;
+  Kernel ax, ay, az;
+  pairAcceleration(Kernel(offset.x), Kernel(offset.y), Kernel(offset.z),
+                   Kernel(mass), Kernel(other.mass), G, ax, ay, az);
+  return Accum(AccumReal(ax), AccumReal(ay), AccumReal(az));
+}
+
+// Verlet step of every body, compiled for the active ISA level
+template <typename P>
+void integrateBodies(std::vector<BasicCelestialBody<P>> &bodies,
+                     float deltaTime);
+
+using CelestialBody = BasicCelestialBody<FloatPrecision>;
+
+extern template class BasicCelestialBody<FloatPrecision>;
+extern template class BasicCelestialBody<DoublePrecision>;
+extern template class BasicCelestialBody<MixedPrecision>;
+
+// cold per-body record, same slot as its CelestialBody
+class BodyVisual {
 public:
-  glm::vec3 position;
-  glm::vec3 velocity;
-  glm::vec3 acceleration;
   glm::vec3 color;
-  float mass;
   float radius;
-  bool isFixed;
 
   // Trajectory
   std::deque<glm::vec3> trajectory;
   static const size_t MAX_TRAJECTORY_POINTS = 500;
 
-  CelestialBody(glm::vec3 pos, glm::vec3 vel, float m, float r, glm::vec3 col,
-                bool fixed = false);
+  BodyVisual(glm::vec3 col = glm::vec3(1.0f), float r = 1.0f);
 
-  void applyGravity(const CelestialBody &other, float G);
-  void update(float deltaTime);
-  void addTrajectoryPoint();
-  void clearTrajectory();
+  void addTrajectoryPoint(const glm::vec3 &position);
+  void clearTrajectory(const glm::vec3 &position);
 };
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "celestialBody.h"
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <ostream>
+#include <vector>
+
+// steps between measurements
+#define CONSERVATION_INTERVAL 64
+// opening angle of the potential walk, tighter than the force default so
+// the measured drift is the integrator's rather than the tree's
+#define CONSERVATION_THETA 0.3f
+#define CONSERVATION_LEAF_CAPACITY 8
+// relative drifts from the baseline that raise an alert
+#define CONSERVATION_ENERGY_ALERT 1e-2
+#define CONSERVATION_MOMENTUM_ALERT 1e-3
+#define CONSERVATION_ANGULAR_MOMENTUM_ALERT 1e-3
+
+// conserved quantities of the active bodies at one step
+struct ConservationSample {
+  uint64_t step = 0;
+  double time = 0.0;
+  size_t bodyCount = 0;
+  size_t fixedCount = 0;
+  double kinetic = 0.0;
+  double potential = 0.0;
+  glm::dvec3 momentum{0.0};
+  // about the fixed body when there is one, else about the origin
+  glm::dvec3 angularMomentum{0.0};
+  // sums of |m v| and |m r x v|, the scales the drifts are relative to
+  double momentumScale = 0.0;
+  double angularMomentumScale = 0.0;
+
+  double energy() const { return kinetic + potential; }
+};
+
+/**
+ *  Drift relative to the baseline sample: energy against |E0|, momentum and
+ *  angular momentum against the sums of |m v| and |m r x v| at the
+ *  baseline, so a system at rest does not divide by zero. Momentum is not
+ *  conserved with a fixed body pulling on the rest, nor angular momentum
+ *  with more than one, and those drifts never alert.
+ * */
+struct ConservationDrift {
+  double energy = 0.0;
+  double momentum = 0.0;
+  double angularMomentum = 0.0;
+  bool momentumConserved = true;
+  bool angularMomentumConserved = true;
+};
+
+/**
+ *  Measures kinetic and potential energy, momentum and angular momentum
+ *  every interval steps. The potential comes from a monopole walk of an
+ *  octree built for the measurement, so a measurement costs about one
+ *  Barnes-Hut step and the monitor costs about 1 / interval of the run.
+ *  The baseline is taken again whenever the active body count changes.
+ * */
+class ConservationMonitor {
+public:
+  int interval;
+  float theta;
+  double energyAlert;
+  double momentumAlert;
+  double angularMomentumAlert;
+  int threadCount;
+  // one CSV line per measurement when set
+  std::ostream *log;
+  // called when a drift first crosses its threshold, and again only after
+  // it has fallen back under it
+  std::function<void(const ConservationSample &, const ConservationDrift &)>
+      onAlert;
+
+  explicit ConservationMonitor(int interval = CONSERVATION_INTERVAL);
+
+  // call once per step after integrating; true when this step was measured
+  template <typename P>
+  bool observe(const std::vector<BasicCelestialBody<P>> &bodies, float G,
+               double time);
+  // measures now, whatever the step
+  template <typename P>
+  ConservationSample measure(const std::vector<BasicCelestialBody<P>> &bodies,
+                             float G) const;
+
+  // the next measurement becomes the baseline
+  void reset();
+
+  bool hasSample() const { return haveBaseline; }
+  const ConservationSample &baseline() const { return first; }
+  const ConservationSample &latest() const { return last; }
+  const ConservationDrift &drift() const { return lastDrift; }
+  // largest drifts seen since the last reset
+  const ConservationDrift &maxDrift() const { return worstDrift; }
+
+private:
+  uint64_t steps;
+  bool haveBaseline;
+  bool alerting;
+  bool headerWritten;
+  ConservationSample first;
+  ConservationSample last;
+  ConservationDrift lastDrift;
+  ConservationDrift worstDrift;
+
+  void record(const ConservationSample &sample);
+};
+
+void writeConservationHeader(std::ostream &out);
+void writeConservationLine(std::ostream &out, const ConservationSample &sample,
+                           const ConservationDrift &drift);
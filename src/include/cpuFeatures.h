@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+
+// the hot kernels' instruction set levels, lowest first
+enum class IsaLevel { Baseline, Avx2, Avx512 };
+
+// highest level both the CPU and the OS support, probed once
+IsaLevel detectedIsaLevel();
+// level the kernels run at: the detected one unless GRAVITY_ISA or
+// setIsaLevel asked for a lower one
+IsaLevel activeIsaLevel();
+// clamped to detectedIsaLevel(), returns the level now active
+IsaLevel setIsaLevel(IsaLevel level);
+
+bool parseIsaLevel(const std::string &name, IsaLevel &level);
+const char *isaLevelName(IsaLevel level);
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ISA_MULTIVERSION 1
+// flatten inlines every call below the variant, so the whole kernel is
+// compiled for the level; FMA contraction is off for gravity_core, so
+// every level gives the baseline's bits
+#define ISA_TARGET_AVX2 __attribute__((target("avx2"), flatten))
+#define ISA_TARGET_AVX512                                                      \
+  __attribute__((target("avx512f,avx512vl,avx512dq,avx512bw,avx2"), flatten))
+// BMI2 comes with every Avx2 level CPU, see probeIsaLevel
+#define ISA_TARGET_BMI2 __attribute__((target("bmi2")))
+
+template <typename Kernel>
+ISA_TARGET_AVX2 void runKernelAvx2(const Kernel &kernel) {
+  kernel();
+}
+
+template <typename Kernel>
+ISA_TARGET_AVX512 void runKernelAvx512(const Kernel &kernel) {
+  kernel();
+}
+#else
+#define ISA_MULTIVERSION 0
+#endif
+
+/**
+ *  Runs kernel() compiled for activeIsaLevel(). Only code that can be
+ *  inlined into the call gets the wider instruction set, so the kernel
+ *  should be a lambda whose callees are defined in the calling
+ *  translation unit or in headers.
+ * */
+template <typename Kernel> void dispatchKernel(const Kernel &kernel) {
+#if ISA_MULTIVERSION
+  switch (activeIsaLevel()) {
+  case IsaLevel::Avx512:
+    runKernelAvx512(kernel);
+    return;
+  case IsaLevel::Avx2:
+    runKernelAvx2(kernel);
+    return;
+  case IsaLevel::Baseline:
+    break;
+  }
+#endif
+  kernel();
+}
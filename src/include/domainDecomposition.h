@@ -0,0 +1,83 @@
+#pragma once
+
+#include "celestialBody.h"
+#include "gravityEngine.h"
+#include "transport.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// steps between recomputing the Morton key frame and the rank splitters;
+// bodies migrate to their owner every step
+#define DOMAIN_REBALANCE_INTERVAL 16
+// cost-weighted key samples each rank contributes to the splitters
+#define DOMAIN_SAMPLES_PER_RANK 256
+#define DOMAIN_EXPORT_LEAF_CAPACITY 8
+
+struct DomainStats {
+  size_t localBodies = 0;
+  // pseudo-bodies standing in for accepted remote cells, and remote bodies
+  // from leaves that had to be opened
+  size_t importedCells = 0;
+  size_t importedBodies = 0;
+  size_t migratedBodies = 0;
+  size_t bytesSent = 0;
+  double exchangeMs = 0.0;
+  double forceMs = 0.0;
+};
+
+/**
+ *  One rank's share of a simulation split along the Morton curve. Each
+ *  rank owns the bodies in its key range, with the splitters placed so
+ *  every rank holds about the same walk cost. For the forces every rank
+ *  sends each other rank its locally essential tree: the cells of its own
+ *  tree that pass the opening criterion for the whole of the other rank's
+ *  bounding box, as point masses, and the bodies of the leaves that do
+ *  not. The receiver walks its own bodies plus the imports, so the far
+ *  field matches a single-process walk at the same theta.
+ *
+ *  Every call is collective: all ranks make it in the same order.
+ * */
+class DistributedSimulation {
+public:
+  float G;
+  float theta;
+  // walks the local bodies plus the imports; ranks sharing a process
+  // through LocalTransport should keep its threadCount at 1
+  BarnesHutEngine engine;
+
+  DistributedSimulation(Transport &transport, float G,
+                        float theta = BARNES_HUT_THETA);
+
+  // rank 0 passes every body and the others nothing; bodies without an id
+  // get their index
+  bool distribute(const std::vector<CelestialBody> &all);
+  // accelerations of the local bodies
+  bool computeForces();
+  bool step(float deltaTime);
+  // every body on rank 0, ordered by id; empty elsewhere
+  bool gather(std::vector<CelestialBody> &all);
+
+  int rank() const { return transport.rank(); }
+  const std::vector<CelestialBody> &localBodies() const { return bodies; }
+  const DomainStats &stats() const { return lastStats; }
+
+private:
+  Transport &transport;
+  std::vector<CelestialBody> bodies;
+  // walk cost of each local body in the last step
+  std::vector<float> costs;
+  glm::vec3 keyMin;
+  float cellsPerUnit;
+  // rank r owns keys in [splitters[r - 1], splitters[r])
+  std::vector<uint64_t> splitters;
+  int stepsSinceBalance;
+  DomainStats lastStats;
+
+  uint64_t keyOf(const CelestialBody &body) const;
+  int ownerOf(uint64_t key) const;
+  bool rebalance();
+  bool migrate();
+  bool exchangeEssential(std::vector<CelestialBody> &imported);
+};
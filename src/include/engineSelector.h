@@ -0,0 +1,94 @@
+#pragma once
+
+#include "autoTuner.h"
+#include "celestialBody.h"
+#include "gravityEngine.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// the choice is made again when the active body count leaves
+// [n / ratio, n * ratio] of the last choice, and every this many steps
+#define ENGINE_SELECT_COUNT_RATIO 1.25f
+#define ENGINE_SELECT_INTERVAL 256
+// the other engine must be predicted this much cheaper to switch to it
+#define ENGINE_SWITCH_MARGIN 0.1f
+// targets whose direct sums are timed to estimate a full direct step
+#define ENGINE_CALIBRATION_SAMPLES 64
+// deterministic mode compares interaction counts, a tree interaction
+// costing this many body-body ones once the walk and build are included
+#define ENGINE_TREE_INTERACTION_COST 2.0
+
+enum class EngineChoice { Auto, Direct, BarnesHut };
+
+bool parseEngineChoice(const std::string &name, EngineChoice &choice);
+const char *engineChoiceName(EngineChoice choice);
+
+// predicted cost of one step behind the last choice, in milliseconds or, in
+// deterministic mode, in body-body interactions
+struct EngineCosts {
+  double direct = 0.0;
+  double barnesHut = 0.0;
+  // taken from the tuning cache rather than measured
+  bool cached = false;
+};
+
+// wall time of a direct step over these bodies, from a strided sample of
+// targets assuming the sum scales with the thread count
+template <typename P>
+double estimateDirectStepMs(const std::vector<BasicCelestialBody<P>> &bodies,
+                            float G, int threads);
+
+/**
+ *  Runs whichever of the direct sum and Barnes-Hut is cheaper for the
+ *  current scene. A choice runs the step with Barnes-Hut, whose result is
+ *  kept, and times direct sums for a sample of targets, so clustering,
+ *  theta and the thread count all show up in the comparison. With a tuning
+ *  cache the tuned step times for the body count are used instead when the
+ *  count changes.
+ * */
+template <typename P> class BasicAutoEngine : public BasicGravityEngine<P> {
+public:
+  using Body = BasicCelestialBody<P>;
+
+  BasicDirectEngine<P> direct;
+  BasicBarnesHutEngine<P> barnesHut;
+  // Direct and BarnesHut force an engine
+  EngineChoice choice;
+  // not owned, may be null
+  const TuningCache *tuningCache;
+
+  BasicAutoEngine();
+  // lastRun points into the engine itself
+  BasicAutoEngine(const BasicAutoEngine &) = delete;
+  BasicAutoEngine &operator=(const BasicAutoEngine &) = delete;
+
+  const char *name() const override { return "auto"; }
+  void computeAccelerations(std::vector<Body> &bodies, float G) override;
+  size_t memoryBytes() const override;
+  void permuteBodyData(const std::vector<size_t> &order) override;
+  void resetBodyData(size_t slot) override;
+
+  // the engine that ran the last step
+  const BasicGravityEngine<P> &current() const { return *lastRun; }
+  const EngineCosts &costs() const { return lastCosts; }
+  // the next step chooses again, e.g. after barnesHut was retuned
+  void reselect() { selectedCount = 0; }
+
+private:
+  bool useDirect;
+  BasicGravityEngine<P> *lastRun;
+  size_t selectedCount;
+  int stepsSinceSelect;
+  EngineCosts lastCosts;
+
+  BasicGravityEngine<P> &chosen();
+  void select(std::vector<Body> &bodies, float G, size_t activeCount,
+              bool countChanged);
+};
+
+using AutoEngine = BasicAutoEngine<FloatPrecision>;
+
+extern template class BasicAutoEngine<FloatPrecision>;
+extern template class BasicAutoEngine<DoublePrecision>;
+extern template class BasicAutoEngine<MixedPrecision>;
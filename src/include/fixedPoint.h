@@ -0,0 +1,57 @@
+#pragma once
+
+#include "celestialBody.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// the frame is this many times wider than the bounds it is fitted to
+#define FIXED_POINT_DOMAIN_MARGIN 4.0
+
+// unsigned integer steps from the frame's corner, 2^32 per axis
+struct FixedPosition {
+  uint32_t x, y, z;
+};
+
+/**
+ *  Power-of-two cube mapped onto 32-bit coordinates. Inside it positions
+ *  are exact integers: drift is integer addition that neither the origin
+ *  nor the machine can change, and a Morton key is just the top bits of
+ *  the three coordinates interleaved. The force kernels see each body as
+ *  its offset from the cube's centre, so their source deltas never carry
+ *  the world origin.
+ * */
+class FixedPointFrame {
+public:
+  glm::dvec3 origin;
+  double unit;
+
+  FixedPointFrame();
+  FixedPointFrame(const glm::dvec3 &center, double size);
+  // centred on the bounds, FIXED_POINT_DOMAIN_MARGIN times their extent
+  static FixedPointFrame fit(const glm::dvec3 &boundsMin,
+                             const glm::dvec3 &boundsMax);
+
+  FixedPosition toFixed(const glm::dvec3 &position) const;
+  glm::dvec3 toWorld(const FixedPosition &position) const;
+  // exact integer difference, scaled once at the end; exact in double
+  glm::dvec3 offset(const FixedPosition &from, const FixedPosition &to) const;
+  // offset from the cube's centre, what the force kernels work on
+  glm::dvec3 toLocal(const FixedPosition &position) const;
+  // moves by whole steps, false if the position had to be clamped
+  bool advance(FixedPosition &position, const glm::dvec3 &displacement) const;
+};
+
+uint64_t mortonKey(const FixedPosition &position);
+// order[newIndex] == oldIndex, no float conversion anywhere
+std::vector<size_t> mortonOrder(const std::vector<FixedPosition> &positions);
+
+// the CelestialBody::update step with positions held in fixed point;
+// body.position is refreshed afterwards as the integer position's offset
+// from the frame's centre, frame.toWorld gives it back in world space.
+// returns how many bodies were clamped at the edge of the frame
+template <typename P>
+size_t integrateFixedPoint(std::vector<BasicCelestialBody<P>> &bodies,
+                           std::vector<FixedPosition> &positions,
+                           const FixedPointFrame &frame, float deltaTime);
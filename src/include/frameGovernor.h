@@ -0,0 +1,88 @@
+#pragma once
+
+#include "octreeNode.h"
+
+// frame time the governor aims for, 60 fps
+#define FRAME_BUDGET_MS 16.6f
+// fidelity is only raised while the predicted frame stays under this
+// fraction of the budget, the gap to the budget is the hysteresis band
+#define GOVERNOR_RECOVER_FRACTION 0.8f
+// frames to wait after a change before judging its effect
+#define GOVERNOR_HOLD_FRAMES 20
+// weight of the newest frame in the smoothed phase costs
+#define GOVERNOR_SMOOTHING 0.1f
+#define GOVERNOR_THETA_STEP 0.1f
+// share of the physics cost one theta step is expected to save or add
+#define GOVERNOR_THETA_GAIN 0.2f
+
+// range each knob may move in; the first value of each pair is the best
+struct FidelityBounds {
+  float minTheta = BARNES_HUT_THETA;
+  float maxTheta = 1.0f;
+  // one force evaluation per frame like the ungoverned viewer; raising
+  // maxSubsteps opts in to spending headroom on more, each one a full
+  // physics step at a smaller dt
+  int maxSubsteps = 1;
+  int minSubsteps = 1;
+  // record a trail point every trailInterval frames
+  int minTrailInterval = 1;
+  int maxTrailInterval = 16;
+  // draw every renderStride-th body
+  int minRenderStride = 1;
+  int maxRenderStride = 16;
+};
+
+struct FidelitySettings {
+  float theta;
+  int substeps;
+  int trailInterval;
+  int renderStride;
+};
+
+// wall time of one frame's phases on the CPU
+struct FramePhases {
+  double physicsMs = 0.0;
+  double trailMs = 0.0;
+  double renderMs = 0.0;
+
+  double totalMs() const { return physicsMs + trailMs + renderMs; }
+};
+
+/**
+ *  Trades simulation and render fidelity for frame time. The smoothed
+ *  phase costs pick the change predicted to save the most when the frame
+ *  is over budget, and the cheapest restore once there is enough headroom
+ *  for it, each followed by a hold so the effect can be measured.
+ * */
+class FrameGovernor {
+public:
+  float budgetMs;
+  FidelityBounds bounds;
+
+  explicit FrameGovernor(float budgetMs = FRAME_BUDGET_MS);
+
+  bool isEnabled() const { return enabled; }
+  // disabling goes back to the best settings
+  void setEnabled(bool value);
+  // best settings again, forgetting the measured costs
+  void reset();
+
+  const FidelitySettings &settings() const { return current; }
+  FidelitySettings bestSettings() const;
+  const FramePhases &smoothedPhases() const { return smoothed; }
+  // 1 with every knob at its best bound, 0 with all at the cheap end
+  float fidelity() const;
+
+  // true when the settings changed
+  bool recordFrame(const FramePhases &phases);
+
+private:
+  bool enabled;
+  FidelitySettings current;
+  FramePhases smoothed;
+  bool primed;
+  int holdFrames;
+
+  bool degrade();
+  bool improve();
+};
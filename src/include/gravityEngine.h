@@ -0,0 +1,172 @@
+#pragma once
+
+#include "celestialBody.h"
+#include "linearTree.h"
+#include "octreeNode.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BARNES_HUT_ZONES_PER_THREAD 4
+// the root cube is a power of two at least this big, padded by this fraction
+#define OCTREE_MIN_ROOT_SIZE 64.0f
+#define OCTREE_ROOT_PADDING 0.05f
+// bodies further from the median position than this factor times the
+// quantile distance are escapers, at most ESCAPER_MAX_COUNT of the furthest
+#define ESCAPER_QUANTILE 0.9f
+#define ESCAPER_RADIUS_FACTOR 8.0f
+#define ESCAPER_MAX_COUNT 64
+// in PlanarMode::Auto the quadtree is used when the tree bodies' y extent is
+// at most this fraction of their extent in x and z
+#define PLANAR_THICKNESS_RATIO 1e-5f
+// sources are summed into this many fixed lanes in deterministic mode
+#define DETERMINISTIC_LANES 8
+// the direct sum walks tiles of targets against tiles of sources: a source
+// tile stays in L1 while every register block of the target tile reads it,
+// and the threads split the target tiles
+#define DIRECT_TARGET_TILE 64
+#define DIRECT_SOURCE_TILE 512
+// targets summed side by side, one vector lane each
+#define DIRECT_TARGET_BLOCK 16
+
+enum class PlanarMode { Auto, Off, On };
+
+bool parsePlanarMode(const std::string &name, PlanarMode &mode);
+const char *planarModeName(PlanarMode mode);
+
+// computes accelerations for every non-fixed body, leaves positions alone
+template <typename P> class BasicGravityEngine {
+public:
+  using Body = BasicCelestialBody<P>;
+
+  int threadCount;
+  InteractionCounters lastCounters;
+
+  // every body's acceleration is summed in an order that depends on
+  // neither threadCount nor the kernel's vector width, so trajectories are
+  // bitwise reproducible
+  bool deterministic;
+
+  BasicGravityEngine();
+  virtual ~BasicGravityEngine() = default;
+
+  virtual const char *name() const = 0;
+  virtual void computeAccelerations(std::vector<Body> &bodies, float G) = 0;
+  virtual size_t memoryBytes() const { return 0; }
+  // the caller reordered the body array, order[newIndex] == oldIndex
+  virtual void permuteBodyData(const std::vector<size_t> &) {}
+  // a new body took this slot, what was kept for the old one is dropped
+  virtual void resetBodyData(size_t) {}
+};
+
+template <typename P> class BasicDirectEngine : public BasicGravityEngine<P> {
+public:
+  using Body = BasicCelestialBody<P>;
+
+  const char *name() const override { return "direct"; }
+  void computeAccelerations(std::vector<Body> &bodies, float G) override;
+};
+
+// the direct engine's tiled sum for the targets in [first, last) only, on
+// the calling thread; returns how many targets it computed
+template <typename P>
+size_t sumDirectRange(std::vector<BasicCelestialBody<P>> &bodies,
+                      size_t first, size_t last, float G, bool deterministic);
+
+template <typename P>
+class BasicBarnesHutEngine : public BasicGravityEngine<P> {
+public:
+  using Body = BasicCelestialBody<P>;
+  using Vec3 = typename P::Vec3;
+
+  float theta;
+  int leafCapacity;
+  int expansionOrder;
+  // capped at OCTREE_DEPTH_LIMIT
+  int maxDepth;
+  float minSize;
+
+  // per-body walk counters of the last step, filled when collectBodyCounters
+  bool collectBodyCounters;
+  std::vector<InteractionCounters> bodyCounters;
+
+  // split the tree-ordered bodies into per-thread segments of equal cost,
+  // using each body's interaction count from the previous step
+  bool useCostZones;
+
+  // On forces the planar quadtree, which drops every body's y offset from
+  // the far field; Auto only picks it for flat scenes
+  PlanarMode planarMode;
+
+  // order of the flattened tree the walk reads; Pointer walks the built
+  // tree in place. Every layout gives the same bits
+  NodeLayout nodeLayout;
+
+  // when the walk takes a cell as a whole; Relative bounds each cell's
+  // error by forceAccuracy times the body's previous acceleration
+  OpeningCriterion openingCriterion;
+  float forceAccuracy;
+
+  BasicBarnesHutEngine(float theta = BARNES_HUT_THETA,
+                       int leafCapacity = OCTREE_LEAF_CAPACITY,
+                       int expansionOrder = BARNES_HUT_EXPANSION_ORDER);
+
+  const char *name() const override { return "barnes-hut"; }
+  void computeAccelerations(std::vector<Body> &bodies, float G) override;
+  size_t memoryBytes() const override;
+  void permuteBodyData(const std::vector<size_t> &order) override;
+  void resetBodyData(size_t slot) override;
+
+  void buildOctree(std::vector<Body> &bodies);
+  size_t escaperCount() const { return escapers.size(); }
+  bool isPlanar() const { return planar; }
+  // whichever of the two is null depends on isPlanar()
+  const BasicOctreeNode<P, 3> *root() const { return octreeRoot.get(); }
+  const BasicOctreeNode<P, 2> *planarRoot() const {
+    return quadtreeRoot.get();
+  }
+  OctreeStats treeStats() const;
+
+private:
+  std::unique_ptr<BasicOctreeNode<P, 3>> octreeRoot;
+  std::unique_ptr<BasicOctreeNode<P, 2>> quadtreeRoot;
+  BasicLinearTree<P, 3> linearOctree;
+  BasicLinearTree<P, 2> linearQuadtree;
+  bool planar;
+  Vec3 spaceMin, spaceMax;
+
+  std::vector<size_t> treeOrder;
+  std::vector<float> bodyCosts;
+  // |a| of each body's last walk, for the Relative criterion
+  std::vector<float> previousAccelerations;
+  // far outliers kept out of the tree so they do not inflate the root
+  // cube; they walk the tree like everyone else and act as direct sources
+  std::vector<size_t> escapers;
+  std::vector<char> isEscaper;
+
+  void calculateBounds(const std::vector<Body> &bodies, int threads);
+  void findEscapers(const std::vector<Body> &bodies, int threads);
+  template <typename Node>
+  void buildTree(std::unique_ptr<Node> &treeRoot, std::vector<Body> &bodies);
+  void updateTreeOrder(const std::vector<Body> &bodies);
+  void growBodyData(size_t count);
+  std::vector<size_t> costZoneBoundaries(int zones) const;
+};
+
+// the float engines everything but the precision studies uses
+using GravityEngine = BasicGravityEngine<FloatPrecision>;
+using DirectEngine = BasicDirectEngine<FloatPrecision>;
+using BarnesHutEngine = BasicBarnesHutEngine<FloatPrecision>;
+
+extern template class BasicGravityEngine<FloatPrecision>;
+extern template class BasicGravityEngine<DoublePrecision>;
+extern template class BasicGravityEngine<MixedPrecision>;
+extern template class BasicDirectEngine<FloatPrecision>;
+extern template class BasicDirectEngine<DoublePrecision>;
+extern template class BasicDirectEngine<MixedPrecision>;
+extern template class BasicBarnesHutEngine<FloatPrecision>;
+extern template class BasicBarnesHutEngine<DoublePrecision>;
+extern template class BasicBarnesHutEngine<MixedPrecision>;
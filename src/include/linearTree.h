@@ -0,0 +1,132 @@
+#pragma once
+
+#include "celestialBody.h"
+#include "octreeNode.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// levels the breadth-first layout keeps in level order; the subtrees below
+// them follow depth-first, each in one run
+#define LINEAR_TREE_BREADTH_LEVELS 4
+// set in LinearNode::count for a leaf
+#define LINEAR_NODE_LEAF 0x80000000u
+
+// Pointer walks the OctreeNode tree where the allocator left it, the others
+// walk a linearized copy in that node order
+enum class NodeLayout { Pointer, DepthFirst, BreadthFirst, VanEmdeBoas };
+
+// the engines' default, the fastest in gravity_bench --layout
+#define BARNES_HUT_NODE_LAYOUT NodeLayout::VanEmdeBoas
+
+bool parseNodeLayout(const std::string &name, NodeLayout &layout);
+const char *nodeLayoutName(NodeLayout layout);
+
+/**
+ *  What the walk reads of a node, 32 bytes for the float octree so two
+ *  share a cache line. Siblings are stored next to each other, so a node
+ *  names its children by the first one's index and their count. Children
+ *  without mass are left out, the walk skips them anyway.
+ * */
+template <typename Real, int Dim> struct alignas(32) LinearNode {
+  glm::vec<Dim, Real> centerOfMass;
+  Real totalMass;
+  Real size;
+  // first child, or a leaf's first body in BasicLinearTree::leafBodies
+  uint32_t first;
+  // children or bodies, LINEAR_NODE_LEAF set for a leaf
+  uint32_t count;
+  // an inner node's ChildBlock in BasicLinearTree::childBlocks
+  uint32_t block;
+};
+
+static_assert(sizeof(LinearNode<float, 3>) == 32,
+              "the float octree node should fill half a cache line");
+
+/**
+ *  What the opening test reads of an inner node's children, side by side:
+ *  lane k is the child at LinearNode::first + k, so the test runs on all
+ *  of them in one vector sequence. Lanes past the last child are zeros.
+ *  Mass and centre offset only feed the Bmax and Relative criteria.
+ * */
+template <typename Real, int Dim> struct alignas(64) ChildBlock {
+  static constexpr int LANES = 1 << Dim;
+
+  Real centerOfMass[Dim][LANES];
+  Real size[LANES];
+  Real centerOffset[LANES];
+  Real totalMass[LANES];
+};
+
+static_assert(sizeof(ChildBlock<float, 3>) == 192,
+              "the float octree's children should fill three cache lines");
+
+/**
+ *  A flattened copy of an OctreeNode tree in one of the NodeLayouts. The
+ *  walk visits nodes in the same order as OctreeNode's, only their
+ *  addresses differ, so every layout gives the pointer walk's bits.
+ *  Quadrupoles sit in a parallel array that only expansion order 2 reads.
+ * */
+template <typename P, int Dim = 3> class BasicLinearTree {
+public:
+  using Node = BasicOctreeNode<P, Dim>;
+  using Body = BasicCelestialBody<P>;
+  using Real = typename P::Real;
+  using Point = typename Node::Point;
+  using HotNode = LinearNode<Real, Dim>;
+  using Block = ChildBlock<Real, Dim>;
+
+  std::vector<HotNode> nodes;
+  std::vector<std::array<Real, Node::QUADRUPOLE_SIZE>> quadrupoles;
+  // one per inner node, in the order of their slots
+  std::vector<Block> childBlocks;
+  // every leaf's bodies, a leaf's in one run
+  std::vector<Body *> leafBodies;
+  // the root's, which has no ChildBlock lane to keep it in
+  Real rootOffset;
+
+  // layout must not be Pointer
+  void build(const Node &root, NodeLayout layout);
+  void clear();
+  void calculateForce(Body &target, float G, InteractionCounters &counters,
+                      const OpeningTest &opening = OpeningTest(),
+                      int expansionOrder = BARNES_HUT_EXPANSION_ORDER) const;
+  size_t memoryBytes() const;
+
+private:
+  // the source tree depth-first with every node's children in one run,
+  // which is also the DepthFirst layout
+  struct Entry {
+    const Node *node;
+    uint32_t firstChild;
+    uint32_t childCount;
+    int depth;
+  };
+  std::vector<Entry> entries;
+  // entries[i] goes to nodes[slots[i]]
+  std::vector<uint32_t> slots;
+  uint32_t nextSlot;
+
+  void collect(uint32_t entry);
+  void placeChildren(uint32_t entry);
+  void placeDepthFirst(uint32_t entry);
+  void placeVanEmdeBoas(uint32_t entry, int levels);
+  void entriesAtDepth(uint32_t entry, int depth,
+                      std::vector<uint32_t> &out) const;
+  static void acceptChildren(const Block &block, const Point &targetPoint,
+                             const OpeningTest &opening, int accept[]);
+  void walk(Body &target, float G, InteractionCounters &counters,
+            const OpeningTest &opening, int expansionOrder) const;
+};
+
+using LinearTree = BasicLinearTree<FloatPrecision>;
+
+extern template class BasicLinearTree<FloatPrecision, 3>;
+extern template class BasicLinearTree<DoublePrecision, 3>;
+extern template class BasicLinearTree<MixedPrecision, 3>;
+extern template class BasicLinearTree<FloatPrecision, 2>;
+extern template class BasicLinearTree<DoublePrecision, 2>;
+extern template class BasicLinearTree<MixedPrecision, 2>;
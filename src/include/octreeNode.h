@@ -1,42 +1,333 @@
 #pragma once
 
 #include "celestialBody.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/geometric.hpp>
 #include <glm/glm.hpp>
 #include <memory>
+#include <string>
+#include <vector>
 
+// defaults of the runtime limits below, see OctreeLimits
 #define BARNES_HUT_THETA 0.5f
 #define OCTREE_MAX_DEPTH 10
 #define OCTREE_MIN_SIZE 0.1f
+#define OCTREE_LEAF_CAPACITY 1
+// hard cap on OctreeLimits::maxDepth, sizes the walk stack
+#define OCTREE_DEPTH_LIMIT 32
+#define BARNES_HUT_EXPANSION_ORDER 0
+// alpha of the Relative opening criterion, a cell's leading error term
+// relative to the target's last acceleration
+#define BARNES_HUT_FORCE_ACCURACY 0.0025f
+// subtrees with more bodies than this are built as separate tasks
+#define OCTREE_PARALLEL_GRAIN 2048
+// pending nodes of one walk: every level opened leaves at most seven
+// siblings waiting
+#define OCTREE_WALK_STACK_SIZE ((OCTREE_DEPTH_LIMIT + 1) * 8)
 
-class OctreeNode {
+// walk counters, accumulated per body and summed per thread
+struct InteractionCounters {
+  uint64_t bodyBody = 0;
+  uint64_t bodyCell = 0;
+  uint64_t nodesOpened = 0;
+
+  uint64_t interactions() const { return bodyBody + bodyCell; }
+
+  InteractionCounters &operator+=(const InteractionCounters &other) {
+    bodyBody += other.bodyBody;
+    bodyCell += other.bodyCell;
+    nodesOpened += other.nodesOpened;
+    return *this;
+  }
+};
+
+/**
+ *  When the walk stops opening a cell of size l, total mass M and centre
+ *  of mass at distance d from the target:
+ *  Geometric   l / d < theta
+ *  Bmax        l / (d - b) < theta, b the centre of mass' offset from the
+ *              cell's centre (Salmon & Warren), so a lopsided cell is
+ *              opened sooner
+ *  Relative    G M l^2 / d^4 <= alpha |a_old| with a_old the target's
+ *              previous acceleration (Gadget-2), and the target not within
+ *              the cell grown by a fifth
+ * */
+enum class OpeningCriterion { Geometric, Bmax, Relative };
+
+bool parseOpeningCriterion(const std::string &name,
+                           OpeningCriterion &criterion);
+const char *openingCriterionName(OpeningCriterion criterion);
+
+// one target's opening criterion and its parameters
+struct OpeningTest {
+  OpeningCriterion criterion = OpeningCriterion::Geometric;
+  float theta = BARNES_HUT_THETA;
+  // Relative only: alpha |a_old| / G
+  double limit = 0.0;
+};
+
+// a node is split while it holds more than leafCapacity bodies, is
+// shallower than maxDepth and at least minSize across
+struct OctreeLimits {
+  int leafCapacity = OCTREE_LEAF_CAPACITY;
+  int maxDepth = OCTREE_MAX_DEPTH;
+  float minSize = OCTREE_MIN_SIZE;
+};
+
+struct OctreeStats {
+  size_t nodeCount = 0;
+  size_t leafCount = 0;
+  size_t emptyLeafCount = 0;
+  size_t memoryBytes = 0;
+  size_t escaperCount = 0;
+  // 3 for the octree, 2 for the planar quadtree
+  int dimensions = 3;
+  // nodes per depth, and leaves per number of bodies they hold
+  std::vector<size_t> depthHistogram;
+  std::vector<size_t> leafOccupancy;
+};
+
+// axes of the body positions a tree of this dimension splits on: all three,
+// or x and z for the planar quadtree over the y = 0 plane the discs lie in
+template <int Dim> struct TreeAxes;
+template <> struct TreeAxes<3> {
+  static constexpr int axis[3] = {0, 1, 2};
+};
+template <> struct TreeAxes<2> {
+  static constexpr int axis[2] = {0, 2};
+};
+
+/**
+ *  Dim == 3 is the octree. Dim == 2 is a quadtree with 2D moments, four
+ *  children per node and 2D far-field kernels, for bodies that all lie in
+ *  the y = 0 plane; their y offsets are ignored everywhere but in the
+ *  leaves, which still use the full 3D body-body kernel.
+ * */
+template <typename P, int Dim = 3> class BasicOctreeNode {
 public:
-  glm::vec3 center;
-  float size;
+  static constexpr int CHILD_COUNT = 1 << Dim;
+  static constexpr int QUADRUPOLE_SIZE = Dim * (Dim + 1) / 2;
 
-  float totalMass;
-  glm::vec3 centerOfMass;
+  using Real = typename P::Real;
+  using Vec3 = typename P::Vec3;
+  using Body = BasicCelestialBody<P>;
+  // a position on the tree's axes
+  using Point = glm::vec<Dim, Real>;
 
-  std::unique_ptr<OctreeNode> children[8];
-  CelestialBody *body;
+  Point center;
+  Real size;
+
+  Real totalMass;
+  Point centerOfMass;
+  // quadrupole about centerOfMass, upper triangle row by row:
+  // xx, xy, xz, yy, yz, zz, or xx, xz, zz when planar
+  Real quadrupole[QUADRUPOLE_SIZE];
+
+  std::unique_ptr<BasicOctreeNode> children[CHILD_COUNT];
+  std::vector<Body *> bodies;
 
   bool isLeaf;
   int depth;
+  OctreeLimits limits;
+  // distance of centerOfMass from center, only the Bmax and Relative
+  // criteria read it
+  Real centerOffset;
 
-  OctreeNode(const glm::vec3 &center, float size, int depth = 0);
-  ~OctreeNode() = default;
-  void insertBody(CelestialBody *celestialBody);
-  void calculateForce(CelestialBody &target, float G,
-                      float theta = BARNES_HUT_THETA) const;
-  void updateMassProperties();
+  BasicOctreeNode(const Point &center, Real size, int depth = 0,
+                  const OctreeLimits &limits = OctreeLimits());
+  ~BasicOctreeNode() = default;
+  void buildSubtree(Body **first, Body **last, Body **scratch);
+  void calculateForce(Body &target, float G, InteractionCounters &counters,
+                      const OpeningTest &opening = OpeningTest(),
+                      int expansionOrder = BARNES_HUT_EXPANSION_ORDER) const;
+  // gravitational potential per unit mass at the target, monopole only
+  double calculatePotential(const Body &target, float G,
+                            float theta = BARNES_HUT_THETA) const;
 
   void clear();
-  int getOctant(const glm::vec3 &position) const;
+  int getOctant(const Point &position) const;
+
+  Point getOctantCenter(int octant) const;
+  bool contains(const Point &position) const;
+  size_t memoryBytes() const;
+  void collectStats(OctreeStats &stats) const;
+  void collectBodies(std::vector<Body *> &out) const;
 
-  glm::vec3 getOctantCenter(int octant) const;
-  bool contains(const glm::vec3 &position) const;
+  static Point project(const Vec3 &position);
+  template <typename T>
+  static glm::vec<3, T> lift(const glm::vec<Dim, T> &point);
+
+  // the walk's per-cell arithmetic, shared with LinearTree so both walks
+  // give the same bits; inline so a dispatched kernel compiles it for its
+  // ISA level
+  static bool acceptsCell(const Point &centerOfMass, Real size,
+                          const Point &targetPoint, float theta);
+  static bool acceptsCell(const Point &centerOfMass, Real size,
+                          Real centerOffset, Real totalMass,
+                          const Point &targetPoint, const OpeningTest &opening);
+  // one criterion each, given the distance to the centre of mass; without
+  // branches so LinearTree can run them on a node's children side by side
+  static bool acceptsGeometric(Real distance, Real size, float theta);
+  static bool acceptsBmax(Real distance, Real size, Real centerOffset,
+                          float theta);
+  static bool acceptsRelative(Real distance, Real size, Real centerOffset,
+                              Real totalMass, Real limit);
+  static void applyMonopole(Body &target, const Point &targetPoint,
+                            const Point &centerOfMass, Real totalMass,
+                            float G);
+  static void applyQuadrupole(Body &target, const Point &targetPoint,
+                              const Point &centerOfMass,
+                              const Real quadrupole[], float G);
 
 private:
+  void walk(Body &target, float G, InteractionCounters &counters,
+            const OpeningTest &opening, int expansionOrder) const;
+  bool shouldSplit(size_t count) const;
   void subdivide();
-  bool shouldUseApproximation(const glm::vec3 &targetPosition,
-                              float theta) const;
+  void combineMassProperties();
+  bool shouldUseApproximation(const Point &targetPosition, float theta) const;
 };
+
+template <typename P, int Dim>
+typename BasicOctreeNode<P, Dim>::Point
+BasicOctreeNode<P, Dim>::project(const Vec3 &position) {
+  Point point;
+  for (int k = 0; k < Dim; k++)
+    point[k] = position[TreeAxes<Dim>::axis[k]];
+  return point;
+}
+
+template <typename P, int Dim>
+template <typename T>
+glm::vec<3, T> BasicOctreeNode<P, Dim>::lift(const glm::vec<Dim, T> &point) {
+  glm::vec<3, T> position(T(0));
+  for (int k = 0; k < Dim; k++)
+    position[TreeAxes<Dim>::axis[k]] = point[k];
+  return position;
+}
+
+// slot of entry (i, j) in the packed upper triangle
+template <int Dim> constexpr int symmetricIndex(int i, int j) {
+  return i <= j ? i * Dim - i * (i - 1) / 2 + (j - i)
+                : symmetricIndex<Dim>(j, i);
+}
+
+template <typename P, int Dim>
+inline bool BasicOctreeNode<P, Dim>::acceptsCell(const Point &centerOfMass,
+                                                 Real size,
+                                                 const Point &targetPoint,
+                                                 float theta) {
+  Real distance = glm::length(centerOfMass - targetPoint);
+
+  if (distance < 0.1f)
+    return false;
+
+  return (size / distance) < theta;
+}
+
+template <typename P, int Dim>
+inline bool BasicOctreeNode<P, Dim>::acceptsGeometric(Real distance,
+                                                      Real size, float theta) {
+  return !(distance < Real(0.1f)) & (size / distance < theta);
+}
+
+template <typename P, int Dim>
+inline bool BasicOctreeNode<P, Dim>::acceptsBmax(Real distance, Real size,
+                                                 Real centerOffset,
+                                                 float theta) {
+  Real reach = distance - centerOffset;
+  return !(distance < Real(0.1f)) & (reach > Real(0.0f)) &
+         (size / reach < theta);
+}
+
+template <typename P, int Dim>
+inline bool BasicOctreeNode<P, Dim>::acceptsRelative(Real distance,
+                                                     Real size,
+                                                     Real centerOffset,
+                                                     Real totalMass,
+                                                     Real limit) {
+  // 0.6 of the cell's diagonal: the centre is at least distance -
+  // centerOffset away, so the target is outside the cell grown by a fifth
+  Real guard = size * Real(Dim == 3 ? 0.6f * 1.7320508f : 0.6f * 1.4142136f);
+  Real distanceSquared = distance * distance;
+  return !(distance < Real(0.1f)) & (distance - centerOffset > guard) &
+         (totalMass * size * size <= limit * distanceSquared * distanceSquared);
+}
+
+template <typename P, int Dim>
+inline bool BasicOctreeNode<P, Dim>::acceptsCell(const Point &centerOfMass,
+                                                 Real size, Real centerOffset,
+                                                 Real totalMass,
+                                                 const Point &targetPoint,
+                                                 const OpeningTest &opening) {
+  if (opening.criterion == OpeningCriterion::Geometric)
+    return acceptsCell(centerOfMass, size, targetPoint, opening.theta);
+
+  Real distance = glm::length(centerOfMass - targetPoint);
+  if (opening.criterion == OpeningCriterion::Bmax)
+    return acceptsBmax(distance, size, centerOffset, opening.theta);
+  return acceptsRelative(distance, size, centerOffset, totalMass,
+                         Real(opening.limit));
+}
+
+template <typename P, int Dim>
+inline void BasicOctreeNode<P, Dim>::applyMonopole(Body &target,
+                                                   const Point &targetPoint,
+                                                   const Point &centerOfMass,
+                                                   Real totalMass, float G) {
+  using Kernel = typename P::Kernel;
+  using KernelPoint = glm::vec<Dim, Kernel>;
+
+  KernelPoint direction(centerOfMass - targetPoint);
+  Kernel distance = glm::length(direction);
+
+  if (distance < Kernel(0.1f))
+    distance = Kernel(0.1f);
+
+  direction = glm::normalize(direction);
+  Kernel forceMagnitude = Kernel(G) * Kernel(target.mass) *
+                          Kernel(totalMass) / (distance * distance);
+  target.acceleration += typename P::Accum(
+      lift(direction * (forceMagnitude / Kernel(target.mass))));
+}
+
+/**
+ *  Quadrupole correction for r = target - centerOfMass
+ *  a = G * Q r / r^5 - 5/2 * G * (r^T Q r) r / r^7
+ * */
+template <typename P, int Dim>
+inline void BasicOctreeNode<P, Dim>::applyQuadrupole(
+    Body &target, const Point &targetPoint, const Point &centerOfMass,
+    const Real quadrupole[], float G) {
+  using Kernel = typename P::Kernel;
+  using KernelPoint = glm::vec<Dim, Kernel>;
+
+  KernelPoint r(targetPoint - centerOfMass);
+  Kernel r2 = glm::dot(r, r);
+  Kernel invR = Kernel(1.0f) / sqrt(r2);
+  Kernel invR5 = invR / (r2 * r2);
+
+  Kernel q[QUADRUPOLE_SIZE];
+  for (int i = 0; i < QUADRUPOLE_SIZE; i++)
+    q[i] = Kernel(quadrupole[i]);
+  KernelPoint qr(Kernel(0.0f));
+  for (int i = 0; i < Dim; i++) {
+    for (int j = 0; j < Dim; j++)
+      qr[i] += q[symmetricIndex<Dim>(i, j)] * r[j];
+  }
+  Kernel rqr = glm::dot(r, qr);
+
+  target.acceleration += typename P::Accum(
+      lift(Kernel(G) * invR5 * (qr - (Kernel(2.5f) * rqr / r2) * r)));
+}
+
+using OctreeNode = BasicOctreeNode<FloatPrecision>;
+template <typename P> using BasicQuadtreeNode = BasicOctreeNode<P, 2>;
+
+extern template class BasicOctreeNode<FloatPrecision, 3>;
+extern template class BasicOctreeNode<DoublePrecision, 3>;
+extern template class BasicOctreeNode<MixedPrecision, 3>;
+extern template class BasicOctreeNode<FloatPrecision, 2>;
+extern template class BasicOctreeNode<DoublePrecision, 2>;
+extern template class BasicOctreeNode<MixedPrecision, 2>;
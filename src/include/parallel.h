@@ -0,0 +1,58 @@
+#pragma once
+
+#include "taskScheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+inline int hardwareThreadCount() {
+  unsigned int count = std::thread::hardware_concurrency();
+  return count == 0 ? 1 : (int)count;
+}
+
+// runs function(boundaries[t], boundaries[t + 1], t) for every range t as
+// a task on the shared scheduler, the calling thread taking range 0
+template <typename Function>
+void parallelForRanges(const std::vector<size_t> &boundaries,
+                       Function &&function) {
+  if (boundaries.size() < 2)
+    return;
+
+  TaskGroup group;
+  size_t ranges = boundaries.size() - 1;
+  for (size_t t = 1; t < ranges; t++) {
+    size_t rangeBegin = boundaries[t];
+    size_t rangeEnd = boundaries[t + 1];
+    if (rangeBegin >= rangeEnd)
+      continue;
+    group.spawn([&function, rangeBegin, rangeEnd, t]() {
+      function(rangeBegin, rangeEnd, (int)t);
+    });
+  }
+
+  if (boundaries[0] < boundaries[1])
+    function(boundaries[0], boundaries[1], 0);
+
+  group.wait();
+}
+
+// splits [begin, end) into one contiguous chunk per thread and calls
+// function(chunkBegin, chunkEnd, threadIndex) on each
+template <typename Function>
+void parallelFor(size_t begin, size_t end, int threadCount,
+                 Function &&function) {
+  size_t count = end > begin ? end - begin : 0;
+  if (threadCount <= 1 || count < 2) {
+    function(begin, end, 0);
+    return;
+  }
+
+  size_t chunks = std::min(count, (size_t)threadCount);
+  size_t chunkSize = (count + chunks - 1) / chunks;
+
+  std::vector<size_t> boundaries(chunks + 1);
+  for (size_t t = 0; t <= chunks; t++)
+    boundaries[t] = std::min(end, begin + t * chunkSize);
+  parallelForRanges(boundaries, function);
+}
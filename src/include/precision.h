@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+
+/**
+ *  Precision policies for bodies, the octree and the engines.
+ *  Real and Vec3 hold positions, velocities, masses and tree moments,
+ *  forces are summed in Accum, and Kernel/KernelVec3 is the arithmetic of
+ *  a single interaction, done on the offset between the two positions.
+ * */
+struct FloatPrecision {
+  using Real = float;
+  using Vec3 = glm::vec3;
+  using Accum = glm::vec3;
+  using Kernel = float;
+  using KernelVec3 = glm::vec3;
+};
+
+struct DoublePrecision {
+  using Real = double;
+  using Vec3 = glm::dvec3;
+  using Accum = glm::dvec3;
+  using Kernel = double;
+  using KernelVec3 = glm::dvec3;
+};
+
+// double positions and sums, float math on the small relative offsets
+struct MixedPrecision {
+  using Real = double;
+  using Vec3 = glm::dvec3;
+  using Accum = glm::dvec3;
+  using Kernel = float;
+  using KernelVec3 = glm::vec3;
+};
+
+enum class PrecisionMode { Float, Double, Mixed };
+
+bool parsePrecisionMode(const std::string &name, PrecisionMode &mode);
+const char *precisionModeName(PrecisionMode mode);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#define PROFILER_RING_CAPACITY 65536
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name)                                                    \
+  ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+struct ProfileEvent {
+  const char *name;
+  uint64_t startNs;
+  uint64_t durationNs;
+  uint32_t threadId;
+};
+
+// fixed-size ring of timed events; writers claim slots with one fetch_add,
+// so recording never takes a lock and the oldest events are overwritten
+class Profiler {
+public:
+  static Profiler &instance();
+
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+  void setEnabled(bool value);
+  void clear();
+
+  uint64_t now() const;
+  void record(const char *name, uint64_t startNs, uint64_t endNs);
+
+  void writeChromeTrace(std::ostream &out) const;
+  void printSummary(std::ostream &out) const;
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    ProfileEvent event;
+  };
+
+  std::atomic<bool> enabled;
+  std::atomic<uint64_t> writeIndex;
+  Slot slots[PROFILER_RING_CAPACITY];
+
+  Profiler();
+  size_t collect(ProfileEvent *out) const;
+};
+
+class ScopedTimer {
+public:
+  explicit ScopedTimer(const char *name)
+      : name(name), startNs(Profiler::instance().isEnabled()
+                                ? Profiler::instance().now()
+                                : 0) {}
+  ~ScopedTimer() {
+    if (startNs != 0)
+      Profiler::instance().record(name, startNs, Profiler::instance().now());
+  }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+  const char *name;
+  uint64_t startNs;
+};
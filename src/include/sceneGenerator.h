@@ -0,0 +1,16 @@
+#pragma once
+
+#include "celestialBody.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class SceneType { Disc, FlatDisc, Plummer };
+
+bool parseSceneType(const std::string &name, SceneType &type);
+const char *sceneTypeName(SceneType type);
+
+// reproducible scenes for benchmarks: the same (type, count, seed) always
+// produces the same bodies
+void generateScene(std::vector<CelestialBody> &bodies, SceneType type,
+                   size_t count, unsigned int seed, float G);
@@ -1,7 +1,12 @@
 #pragma once
 
+#include "autoTuner.h"
+#include "bodyPool.h"
 #include "celestialBody.h"
-#include "octreeNode.h"
+#include "conservationMonitor.h"
+#include "engineSelector.h"
+#include "frameGovernor.h"
+#include "gravityEngine.h"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -23,11 +28,25 @@
 #define POINT_SCALE_SIZE 500.0f
 #define MIN_POINT_SIZE 2.0f
 #define MAX_POINT_SIZE 50.0f
+#define PROFILER_TRACE_FILE "gravity_trace.json"
+#define SNAPSHOT_FILE_PREFIX "snapshot_"
+// bodies further than this from the origin are removed, 0 keeps them all
+#define DEFAULT_ESCAPE_RADIUS 2000.0f
+// fidelity bar in the top left corner, in normalized device coordinates
+#define FIDELITY_BAR_X -0.95f
+#define FIDELITY_BAR_Y 0.93f
+#define FIDELITY_BAR_WIDTH 0.3f
 
 class Simulation {
 private:
-  std::vector<CelestialBody> bodies;
-  std::unique_ptr<OctreeNode> octreeRoot;
+  BodyPool bodyPool;
+  TuningCache tuningCache;
+  // direct sum or Barnes-Hut, picked per scene size unless one is forced
+  AutoEngine engine;
+  FrameGovernor governor;
+  ConservationMonitor conservation;
+  bool monitorConservation;
+  FramePhases framePhases;
 
   GLuint VAO, VBO, shaderProgram;
   GLuint trajectoryVAO, trajectoryVBO, trajectoryShaderProgram;
@@ -39,10 +58,11 @@ private:
   bool paused;
   float timeScale;
   bool showTrajectories;
-  bool useBarnesHut;
   int trajectoryUpdateCounter;
-
-  glm::vec3 spaceMin, spaceMax;
+  int reorderCounter;
+  double simulationTime;
+  int snapshotCounter;
+  float escapeRadius;
 
   // Shader sources
   static const char *vertexShaderSource;
@@ -59,11 +79,15 @@ private:
   void checkShaderCompilation(GLuint shader, const std::string &type);
   void checkProgramLinking(GLuint program);
   void renderTrajectories();
+  void renderFidelityIndicator();
 
-  void buildOctree();
-  void calculateBounds();
-  void updateGravityBarnesHut();
-  void updateGravityDirect();
+  void updateGravity();
+  void reorderBodies();
+  void compactBodies();
+  void saveSnapshot();
+  void applyCachedTuning();
+  void tuneBarnesHut();
+  void setBaseTheta(float theta);
 
 public:
   Simulation();
@@ -72,4 +96,11 @@ public:
   void update(float deltaTime);
   void render(int width, int height);
   void handleInput(GLFWwindow *window);
+
+  uint64_t addBody(const CelestialBody &body);
+  bool removeBody(uint64_t id);
+  size_t bodyCount() const { return bodyPool.activeCount(); }
+  void setEscapeRadius(float radius) { escapeRadius = radius; }
+  // engine in use and fidelity settings, for the window title
+  std::string statusSummary() const;
 };
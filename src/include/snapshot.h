@@ -0,0 +1,10 @@
+#pragma once
+
+#include "celestialBody.h"
+#include <string>
+#include <vector>
+
+// one CSV row per body keyed by its stable id:
+// id,x,y,z,vx,vy,vz,mass,fixed
+bool writeSnapshot(const std::string &path,
+                   const std::vector<CelestialBody> &bodies, double time);
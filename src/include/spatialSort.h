@@ -0,0 +1,43 @@
+#pragma once
+
+#include "celestialBody.h"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+#define BODY_REORDER_INTERVAL 32
+#define MORTON_BITS_PER_AXIS 21
+
+// interleaves the low 21 bits of x, y and z, x in the lowest bit
+uint64_t interleaveBits(uint32_t x, uint32_t y, uint32_t z);
+
+// 63-bit Morton key, x in the lowest bit of every triple so that the key
+// order matches OctreeNode's octant numbering and depth-first walk
+uint64_t mortonKey(const glm::vec3 &position, const glm::vec3 &boundsMin,
+                   float cellsPerUnit);
+
+// permutation sorting the bodies along the Morton curve:
+// order[newIndex] == oldIndex
+template <typename P>
+std::vector<size_t>
+mortonOrder(const std::vector<BasicCelestialBody<P>> &bodies);
+
+// gathers data[order[i]] into slot i; order may be shorter than data when
+// the body array was compacted. Empty data, per-body data that is not being
+// kept, is left alone; any other data must cover every index in order
+template <typename T>
+void applyPermutation(std::vector<T> &data, const std::vector<size_t> &order) {
+  if (data.empty())
+    return;
+
+  std::vector<T> sorted;
+  sorted.reserve(order.size());
+  for (size_t oldIndex : order) {
+    assert(oldIndex < data.size() && "per-body data out of step with bodies");
+    sorted.push_back(std::move(data[oldIndex]));
+  }
+  data.swap(sorted);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+// work-stealing pool: every thread owns a deque, pushes and pops its own
+// work LIFO and, when empty, steals half of a victim's deque from the FIFO
+// end, where the oldest and usually largest tasks sit. Slot 0 belongs to
+// the thread driving the scheduler, which helps out while it waits.
+class TaskScheduler {
+public:
+  static TaskScheduler &instance();
+
+  explicit TaskScheduler(int threadCount = 1);
+  ~TaskScheduler();
+
+  int threadCount() const { return (int)queues.size(); }
+  // restarts the workers; only call while no tasks are outstanding
+  void setThreadCount(int count);
+
+private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> function;
+    TaskGroup *group;
+  };
+
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::atomic<int> queuedTasks;
+  std::atomic<bool> stopping;
+
+  void start(int count);
+  void stop();
+  void workerLoop(int slot);
+
+  int currentSlot() const;
+  void push(Task task);
+  bool popOrSteal(int slot, Task &task);
+  bool stealHalf(int thief, Task &task);
+  void run(Task &task);
+};
+
+// fork-join handle: spawn() forks, wait() joins every task spawned through
+// this group, running queued work on the waiting thread in the meantime
+class TaskGroup {
+public:
+  explicit TaskGroup(TaskScheduler &scheduler = TaskScheduler::instance());
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void spawn(std::function<void()> function);
+  void wait();
+
+private:
+  friend class TaskScheduler;
+
+  TaskScheduler &scheduler;
+  std::atomic<int> pending;
+};
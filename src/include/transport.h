@@ -0,0 +1,132 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class TransportType { Local, Socket, Mpi };
+
+bool parseTransportType(const std::string &name, TransportType &type);
+const char *transportTypeName(TransportType type);
+
+/**
+ *  Point-to-point byte messages between the ranks of one run. send never
+ *  waits for the receiver, so every rank can send to everyone before it
+ *  receives anything, and messages from one source arrive in the order
+ *  they were sent. A false return means the peer is gone.
+ * */
+class Transport {
+public:
+  virtual ~Transport() = default;
+
+  virtual int rank() const = 0;
+  virtual int size() const = 0;
+  virtual bool send(int destination, const std::vector<char> &message) = 0;
+  virtual bool receive(int source, std::vector<char> &message) = 0;
+};
+
+// outgoing[r] goes to rank r and incoming[r] came from it; the own entry
+// is moved across without a message
+bool allToAll(Transport &transport, std::vector<std::vector<char>> &outgoing,
+              std::vector<std::vector<char>> &incoming);
+// every rank's message, in rank order
+bool allGather(Transport &transport, const std::vector<char> &message,
+               std::vector<std::vector<char>> &messages);
+
+// per-source FIFO queues the receiving side of a transport waits on
+class Mailbox {
+public:
+  explicit Mailbox(int sources);
+
+  void post(int source, std::vector<char> message);
+  // a closed source still hands out what it already posted
+  void close(int source);
+  bool take(int source, std::vector<char> &message);
+
+private:
+  std::mutex mutex;
+  std::condition_variable posted;
+  std::vector<std::deque<std::vector<char>>> queues;
+  std::vector<bool> closed;
+};
+
+/**
+ *  Ranks as threads of one process exchanging messages through shared
+ *  mailboxes, for tests and for single-node runs without the copies a
+ *  socket costs. create() returns one transport per rank.
+ * */
+class LocalTransport : public Transport {
+public:
+  static std::vector<std::unique_ptr<Transport>> create(int ranks);
+
+  int rank() const override { return ownRank; }
+  int size() const override { return (int)mailboxes->size(); }
+  bool send(int destination, const std::vector<char> &message) override;
+  bool receive(int source, std::vector<char> &message) override;
+
+private:
+  int ownRank;
+  std::shared_ptr<std::vector<std::unique_ptr<Mailbox>>> mailboxes;
+
+  LocalTransport(int rank,
+                 std::shared_ptr<std::vector<std::unique_ptr<Mailbox>>> boxes);
+};
+
+/**
+ *  Ranks as processes connected pairwise by Unix domain sockets. spawn()
+ *  forks ranks - 1 children and returns the calling process's transport:
+ *  rank 0 in the parent, the child's own rank in each child. It must run
+ *  before any other thread starts, children should _exit when done, and
+ *  rank 0 reaps them when its transport is destroyed. A reader thread per
+ *  peer drains its socket into the mailbox, so sends cannot deadlock on
+ *  full socket buffers.
+ * */
+class SocketTransport : public Transport {
+public:
+  static std::unique_ptr<Transport> spawn(int ranks);
+  ~SocketTransport() override;
+
+  int rank() const override { return ownRank; }
+  int size() const override { return (int)sockets.size(); }
+  bool send(int destination, const std::vector<char> &message) override;
+  bool receive(int source, std::vector<char> &message) override;
+
+private:
+  int ownRank;
+  // sockets[ownRank] is unused
+  std::vector<int> sockets;
+  std::vector<int> children;
+  Mailbox mailbox;
+  std::vector<std::thread> readers;
+
+  SocketTransport(int rank, std::vector<int> sockets,
+                  std::vector<int> children);
+  void readFrom(int peer);
+};
+
+#ifdef GRAVITY_WITH_MPI
+// one rank per MPI process; MPI_Init and MPI_Finalize are the caller's
+class MpiTransport : public Transport {
+public:
+  MpiTransport();
+  ~MpiTransport() override;
+
+  int rank() const override { return ownRank; }
+  int size() const override { return rankCount; }
+  bool send(int destination, const std::vector<char> &message) override;
+  bool receive(int source, std::vector<char> &message) override;
+
+private:
+  int ownRank;
+  int rankCount;
+  struct Pending;
+  std::vector<std::unique_ptr<Pending>> pending;
+
+  void completeSends(bool wait);
+};
+#endif
@@ -0,0 +1,340 @@
+#include "include/linearTree.h"
+#include "include/cpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH_NODE(address) __builtin_prefetch(address)
+#else
+#define PREFETCH_NODE(address) ((void)(address))
+#endif
+
+bool parseNodeLayout(const std::string &name, NodeLayout &layout) {
+  if (name == "pointer")
+    layout = NodeLayout::Pointer;
+  else if (name == "dfs")
+    layout = NodeLayout::DepthFirst;
+  else if (name == "bfs")
+    layout = NodeLayout::BreadthFirst;
+  else if (name == "veb")
+    layout = NodeLayout::VanEmdeBoas;
+  else
+    return false;
+  return true;
+}
+
+const char *nodeLayoutName(NodeLayout layout) {
+  switch (layout) {
+  case NodeLayout::Pointer:
+    return "pointer";
+  case NodeLayout::DepthFirst:
+    return "dfs";
+  case NodeLayout::BreadthFirst:
+    return "bfs";
+  case NodeLayout::VanEmdeBoas:
+    return "veb";
+  }
+  return "unknown";
+}
+
+template <typename P, int Dim> void BasicLinearTree<P, Dim>::clear() {
+  nodes.clear();
+  quadrupoles.clear();
+  childBlocks.clear();
+  leafBodies.clear();
+}
+
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::collect(uint32_t entry) {
+  const Node &node = *entries[entry].node;
+  if (node.isLeaf)
+    return;
+
+  uint32_t first = (uint32_t)entries.size();
+  for (int i = 0; i < Node::CHILD_COUNT; i++) {
+    const Node *child = node.children[i].get();
+    if (child != nullptr && child->totalMass != 0.0f)
+      entries.push_back({child, 0, 0, entries[entry].depth + 1});
+  }
+  uint32_t last = (uint32_t)entries.size();
+  entries[entry].firstChild = first;
+  entries[entry].childCount = last - first;
+  for (uint32_t k = first; k < last; k++)
+    collect(k);
+}
+
+// a node's children always get consecutive slots
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::placeChildren(uint32_t entry) {
+  const Entry &parent = entries[entry];
+  for (uint32_t k = 0; k < parent.childCount; k++)
+    slots[parent.firstChild + k] = nextSlot++;
+}
+
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::placeDepthFirst(uint32_t entry) {
+  placeChildren(entry);
+  const Entry &parent = entries[entry];
+  for (uint32_t k = 0; k < parent.childCount; k++)
+    placeDepthFirst(parent.firstChild + k);
+}
+
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::entriesAtDepth(
+    uint32_t entry, int depth, std::vector<uint32_t> &out) const {
+  if (depth == 0) {
+    out.push_back(entry);
+    return;
+  }
+  const Entry &parent = entries[entry];
+  for (uint32_t k = 0; k < parent.childCount; k++)
+    entriesAtDepth(parent.firstChild + k, depth - 1, out);
+}
+
+/**
+ *  Places the child runs of the nodes less than `levels` below entry: the
+ *  top half of those levels first, recursively, then each subtree hanging
+ *  off it, so any walk down the tree crosses O(log_B n) cache blocks
+ *  whatever the block size B.
+ * */
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::placeVanEmdeBoas(uint32_t entry, int levels) {
+  if (levels <= 0 || entries[entry].childCount == 0)
+    return;
+  if (levels == 1) {
+    placeChildren(entry);
+    return;
+  }
+
+  int top = (levels + 1) / 2;
+  placeVanEmdeBoas(entry, top);
+  std::vector<uint32_t> bottoms;
+  entriesAtDepth(entry, top, bottoms);
+  for (uint32_t bottom : bottoms)
+    placeVanEmdeBoas(bottom, levels - top);
+}
+
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::build(const Node &root, NodeLayout layout) {
+  clear();
+  entries.clear();
+  if (root.totalMass == 0.0f)
+    return;
+
+  entries.push_back({&root, 0, 0, 0});
+  collect(0);
+
+  slots.assign(entries.size(), 0);
+  nextSlot = 1;
+  switch (layout) {
+  case NodeLayout::Pointer:
+  case NodeLayout::DepthFirst:
+    placeDepthFirst(0);
+    break;
+  case NodeLayout::BreadthFirst: {
+    std::deque<uint32_t> queue{0};
+    std::vector<uint32_t> frontier;
+    while (!queue.empty()) {
+      uint32_t entry = queue.front();
+      queue.pop_front();
+      if (entries[entry].depth >= LINEAR_TREE_BREADTH_LEVELS) {
+        frontier.push_back(entry);
+        continue;
+      }
+      placeChildren(entry);
+      for (uint32_t k = 0; k < entries[entry].childCount; k++)
+        queue.push_back(entries[entry].firstChild + k);
+    }
+    for (uint32_t entry : frontier)
+      placeDepthFirst(entry);
+    break;
+  }
+  case NodeLayout::VanEmdeBoas: {
+    int depth = 0;
+    for (const Entry &entry : entries)
+      depth = std::max(depth, entry.depth);
+    placeVanEmdeBoas(0, depth);
+    break;
+  }
+  }
+
+  std::vector<uint32_t> entryAt(entries.size());
+  for (uint32_t i = 0; i < entries.size(); i++)
+    entryAt[slots[i]] = i;
+
+  nodes.resize(entries.size());
+  quadrupoles.resize(entries.size());
+  rootOffset = root.centerOffset;
+  for (uint32_t slot = 0; slot < entries.size(); slot++) {
+    const Entry &entry = entries[entryAt[slot]];
+    const Node &node = *entry.node;
+    HotNode &hot = nodes[slot];
+    hot.block = 0;
+    hot.centerOfMass = node.centerOfMass;
+    hot.totalMass = node.totalMass;
+    hot.size = node.size;
+    std::copy(node.quadrupole, node.quadrupole + Node::QUADRUPOLE_SIZE,
+              quadrupoles[slot].begin());
+    if (node.isLeaf) {
+      // in slot order, so leaves placed together keep their bodies together
+      hot.first = (uint32_t)leafBodies.size();
+      hot.count = (uint32_t)node.bodies.size() | LINEAR_NODE_LEAF;
+      leafBodies.insert(leafBodies.end(), node.bodies.begin(),
+                        node.bodies.end());
+    } else {
+      hot.first = entry.childCount > 0 ? slots[entry.firstChild] : 0;
+      hot.count = entry.childCount;
+      hot.block = (uint32_t)childBlocks.size();
+      Block block = {};
+      for (uint32_t k = 0; k < entry.childCount; k++) {
+        const Node &child = *entries[entry.firstChild + k].node;
+        for (int axis = 0; axis < Dim; axis++)
+          block.centerOfMass[axis][k] = child.centerOfMass[axis];
+        block.size[k] = child.size;
+        block.centerOffset[k] = child.centerOffset;
+        block.totalMass[k] = child.totalMass;
+      }
+      childBlocks.push_back(block);
+    }
+  }
+}
+
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::calculateForce(Body &target, float G,
+                                             InteractionCounters &counters,
+                                             const OpeningTest &opening,
+                                             int expansionOrder) const {
+  dispatchKernel(
+      [&]() { walk(target, G, counters, opening, expansionOrder); });
+}
+
+/**
+ *  Node::acceptsCell for every lane at once, accept[k] set when child k is
+ *  taken as a point mass. The same operations in the same order, so every
+ *  lane agrees with the scalar test bit for bit. The verdicts go through
+ *  memory: a mask returned in a register is built lane by lane instead.
+ *  The criterion is picked once, outside the lane loops.
+ * */
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::acceptChildren(const Block &block,
+                                             const Point &targetPoint,
+                                             const OpeningTest &opening,
+                                             int accept[]) {
+  Real target[Dim];
+  for (int axis = 0; axis < Dim; axis++)
+    target[axis] = targetPoint[axis];
+
+  Real distance[Block::LANES];
+  for (int lane = 0; lane < Block::LANES; lane++) {
+    Real distanceSquared = 0;
+    for (int axis = 0; axis < Dim; axis++) {
+      Real delta = block.centerOfMass[axis][lane] - target[axis];
+      distanceSquared += delta * delta;
+    }
+    distance[lane] = std::sqrt(distanceSquared);
+  }
+
+  switch (opening.criterion) {
+  case OpeningCriterion::Bmax:
+    for (int lane = 0; lane < Block::LANES; lane++)
+      accept[lane] = Node::acceptsBmax(distance[lane], block.size[lane],
+                                       block.centerOffset[lane],
+                                       opening.theta);
+    break;
+  case OpeningCriterion::Relative: {
+    Real limit = Real(opening.limit);
+    for (int lane = 0; lane < Block::LANES; lane++)
+      accept[lane] = Node::acceptsRelative(
+          distance[lane], block.size[lane], block.centerOffset[lane],
+          block.totalMass[lane], limit);
+    break;
+  }
+  default:
+    for (int lane = 0; lane < Block::LANES; lane++)
+      accept[lane] = Node::acceptsGeometric(distance[lane], block.size[lane],
+                                            opening.theta);
+  }
+}
+
+/**
+ *  OctreeNode's walk over indices. Opening a node tests all its children
+ *  against the opening criterion in one go and pushes each with its
+ *  verdict, then prefetches the children run, which the next iterations
+ *  pop one after another.
+ * */
+template <typename P, int Dim>
+void BasicLinearTree<P, Dim>::walk(Body &target, float G,
+                                   InteractionCounters &counters,
+                                   const OpeningTest &opening,
+                                   int expansionOrder) const {
+  if (nodes.empty())
+    return;
+
+  Point targetPoint = Node::project(target.position);
+  // the verdicts sit apart from the indices, so loading the next node does
+  // not wait for the opening test
+  uint32_t stack[OCTREE_WALK_STACK_SIZE];
+  int acceptStack[OCTREE_WALK_STACK_SIZE];
+  int top = 0;
+  stack[top] = 0;
+  acceptStack[top++] =
+      Node::acceptsCell(nodes[0].centerOfMass, nodes[0].size, rootOffset,
+                        nodes[0].totalMass, targetPoint, opening);
+
+  while (top > 0) {
+    uint32_t index = stack[--top];
+    const HotNode &node = nodes[index];
+
+    if (node.count & LINEAR_NODE_LEAF) {
+      uint32_t end = node.first + (node.count & ~LINEAR_NODE_LEAF);
+      for (uint32_t k = node.first; k < end; k++) {
+        const Body *body = leafBodies[k];
+        if (body == &target)
+          continue;
+        target.applyGravity(*body, G);
+        counters.bodyBody++;
+      }
+      continue;
+    }
+
+    if (acceptStack[top]) {
+      Node::applyMonopole(target, targetPoint, node.centerOfMass,
+                          node.totalMass, G);
+      if (expansionOrder >= 2)
+        Node::applyQuadrupole(target, targetPoint, node.centerOfMass,
+                              quadrupoles[index].data(), G);
+      counters.bodyCell++;
+      continue;
+    }
+
+    counters.nodesOpened++;
+    int accept[Block::LANES];
+    acceptChildren(childBlocks[node.block], targetPoint, opening, accept);
+    const char *run = reinterpret_cast<const char *>(&nodes[node.first]);
+    for (size_t offset = 0; offset < node.count * sizeof(HotNode);
+         offset += 64)
+      PREFETCH_NODE(run + offset);
+    for (uint32_t k = node.count; k > 0; k--) {
+      stack[top] = node.first + k - 1;
+      acceptStack[top++] = accept[k - 1];
+    }
+  }
+}
+
+template <typename P, int Dim>
+size_t BasicLinearTree<P, Dim>::memoryBytes() const {
+  return nodes.capacity() * sizeof(HotNode) +
+         quadrupoles.capacity() * sizeof(quadrupoles[0]) +
+         childBlocks.capacity() * sizeof(Block) +
+         leafBodies.capacity() * sizeof(Body *) +
+         entries.capacity() * sizeof(Entry) +
+         slots.capacity() * sizeof(uint32_t);
+}
+
+template class BasicLinearTree<FloatPrecision, 3>;
+template class BasicLinearTree<DoublePrecision, 3>;
+template class BasicLinearTree<MixedPrecision, 3>;
+template class BasicLinearTree<FloatPrecision, 2>;
+template class BasicLinearTree<DoublePrecision, 2>;
+template class BasicLinearTree<MixedPrecision, 2>;
@@ -2,6 +2,7 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <string>
 
 int main() {
   // GLFW
@@ -40,7 +41,12 @@ int main() {
   std::cout << "W/S - Speed up/slow down time\n";
   std::cout << "A/D - zoom in/out\n";
   std::cout << "T - Toggle trajectory\n";
-  std::cout << "B - Toggle algorithm\n";
+  std::cout << "B - Cycle algorithm (auto, Barnes-Hut, direct)\n";
+  std::cout << "P - Start/stop profiler\n";
+  std::cout << "O - Write snapshot\n";
+  std::cout << "U - Tune Barnes-Hut\n";
+  std::cout << "G - Toggle frame-budget governor\n";
+  std::cout << "E - Toggle conservation monitor\n";
   std::cout << "R - reset simulation\n";
   std::cout << "Esc - Exit\n";
   std::cout << "========================================\n";
@@ -67,13 +73,15 @@ int main() {
     glfwSwapBuffers(window);
     glfwPollEvents();
 
-    // frameCount++;
-    // fpsTimer += deltaTime;
-    // if (fpsTimer >= 1.0f) {
-    //   std::cout << "FPS: " << frameCount << "\n";
-    //   frameCount = 0;
-    //   fpsTimer = 0.0f;
-    // }
+    frameCount++;
+    fpsTimer += deltaTime;
+    if (fpsTimer >= 1.0f) {
+      std::string title = "Gravity Simulator - " + std::to_string(frameCount) +
+                          " fps, " + simulation.statusSummary();
+      glfwSetWindowTitle(window, title.c_str());
+      frameCount = 0;
+      fpsTimer = 0.0f;
+    }
   }
   glfwTerminate();
   return 0;
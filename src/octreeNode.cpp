@@ -1,168 +1,387 @@
 #include "include/octreeNode.h"
 #include "include/celestialBody.h"
+#include "include/cpuFeatures.h"
+#include "include/taskScheduler.h"
+#include <algorithm>
+#include <cmath>
 #include <glm/geometric.hpp>
 #include <memory>
 
-OctreeNode::OctreeNode(const glm::vec3 &center, float size, int depth)
+bool parseOpeningCriterion(const std::string &name,
+                           OpeningCriterion &criterion) {
+  if (name == "geometric")
+    criterion = OpeningCriterion::Geometric;
+  else if (name == "bmax")
+    criterion = OpeningCriterion::Bmax;
+  else if (name == "relative")
+    criterion = OpeningCriterion::Relative;
+  else
+    return false;
+  return true;
+}
+
+const char *openingCriterionName(OpeningCriterion criterion) {
+  switch (criterion) {
+  case OpeningCriterion::Geometric:
+    return "geometric";
+  case OpeningCriterion::Bmax:
+    return "bmax";
+  case OpeningCriterion::Relative:
+    return "relative";
+  }
+  return "unknown";
+}
+
+template <typename P, int Dim>
+BasicOctreeNode<P, Dim>::BasicOctreeNode(const Point &center, Real size,
+                                         int depth,
+                                         const OctreeLimits &limits)
     : center(center), size(size), totalMass(0.0f), centerOfMass(0.0f),
-      body(nullptr), isLeaf(true), depth(depth) {
-  for (int i = 0; i < 8; i++)
+      isLeaf(true), depth(depth), limits(limits), centerOffset(0.0f) {
+  for (int i = 0; i < CHILD_COUNT; i++)
     children[i] = nullptr;
+  for (int i = 0; i < QUADRUPOLE_SIZE; i++)
+    quadrupole[i] = 0.0f;
 }
 
-void OctreeNode::insertBody(CelestialBody *celestialBody) {
-  if (!contains(celestialBody->position))
-    return;
+// adds m * (3 d d^T - |d|^2 I) for a point mass at offset d
+template <int Dim, typename Real>
+static void addPointQuadrupole(Real quadrupole[], const glm::vec<Dim, Real> &d,
+                               Real m) {
+  Real d2 = glm::dot(d, d);
+  for (int i = 0; i < Dim; i++) {
+    quadrupole[symmetricIndex<Dim>(i, i)] += m * (3.0f * d[i] * d[i] - d2);
+    for (int j = i + 1; j < Dim; j++)
+      quadrupole[symmetricIndex<Dim>(i, j)] += m * (3.0f * d[i] * d[j]);
+  }
+}
 
-  if (totalMass == 0.0f) {
-    body = celestialBody;
-    totalMass = celestialBody->mass;
-    centerOfMass = celestialBody->position;
+/**
+ *  Bulk top-down build of the tree over [first, last): a node splits while
+ *  shouldSplit allows it. Bodies are partitioned into octants through
+ *  scratch (same length as the range), large children are built as tasks
+ *  and the moments are combined once every child has finished.
+ * */
+template <typename P, int Dim>
+void BasicOctreeNode<P, Dim>::buildSubtree(Body **first, Body **last,
+                                      Body **scratch) {
+  size_t count = last - first;
+  if (!shouldSplit(count)) {
     isLeaf = true;
+    bodies.assign(first, last);
+    combineMassProperties();
     return;
   }
-  if (isLeaf && body != nullptr) {
-    if (depth >= OCTREE_MAX_DEPTH || size < OCTREE_MIN_SIZE) {
-      float newTotalMass = totalMass + celestialBody->mass;
-      centerOfMass = (centerOfMass * totalMass +
-                      celestialBody->position * celestialBody->mass) /
-                     newTotalMass;
-      totalMass = newTotalMass;
-      return;
-    }
 
-    CelestialBody *existingBody = body;
-    body = nullptr;
-    isLeaf = false;
-    subdivide();
+  isLeaf = false;
+  subdivide();
 
-    int existingOctant = getOctant(existingBody->position);
-    children[existingOctant]->insertBody(existingBody);
+  size_t offsets[CHILD_COUNT + 1] = {0};
+  for (Body **body = first; body != last; body++)
+    offsets[getOctant(project((*body)->position)) + 1]++;
+  for (int i = 0; i < CHILD_COUNT; i++)
+    offsets[i + 1] += offsets[i];
 
-    int newOctant = getOctant(celestialBody->position);
-    children[newOctant]->insertBody(celestialBody);
-  } else if (!isLeaf) {
-    int octant = getOctant(celestialBody->position);
-    children[octant]->insertBody(celestialBody);
+  size_t cursor[CHILD_COUNT];
+  for (int i = 0; i < CHILD_COUNT; i++)
+    cursor[i] = offsets[i];
+  for (Body **body = first; body != last; body++)
+    scratch[cursor[getOctant(project((*body)->position))]++] = *body;
+  std::copy(scratch, scratch + count, first);
+
+  TaskGroup group;
+  for (int i = 0; i < CHILD_COUNT; i++) {
+    size_t childBegin = offsets[i];
+    size_t childEnd = offsets[i + 1];
+    BasicOctreeNode *child = children[i].get();
+    if (childEnd - childBegin > OCTREE_PARALLEL_GRAIN) {
+      group.spawn([=]() {
+        child->buildSubtree(first + childBegin, first + childEnd,
+                            scratch + childBegin);
+      });
+    } else {
+      child->buildSubtree(first + childBegin, first + childEnd,
+                          scratch + childBegin);
+    }
   }
-  updateMassProperties();
+  group.wait();
+
+  combineMassProperties();
 }
 
-void OctreeNode::calculateForce(CelestialBody &target, float G,
-                                float theta) const {
-  if (totalMass == 0.0f)
-    return;
+template <typename P, int Dim>
+void BasicOctreeNode<P, Dim>::calculateForce(Body &target, float G,
+                                             InteractionCounters &counters,
+                                             const OpeningTest &opening,
+                                             int expansionOrder) const {
+  dispatchKernel(
+      [&]() { walk(target, G, counters, opening, expansionOrder); });
+}
 
-  if (isLeaf && body != nullptr) {
-    if (body == &target)
-      return;
-    target.applyGravity(*body, G);
-    return;
+/**
+ *  Iterative so that one dispatched kernel holds the whole walk. Children
+ *  are pushed in reverse, so nodes are visited in the same depth-first
+ *  octant order as the recursive walk and the sums come out identical.
+ * */
+template <typename P, int Dim>
+void BasicOctreeNode<P, Dim>::walk(Body &target, float G,
+                                   InteractionCounters &counters,
+                                   const OpeningTest &opening,
+                                   int expansionOrder) const {
+  Point targetPoint = project(target.position);
+  const BasicOctreeNode *stack[OCTREE_WALK_STACK_SIZE];
+  int top = 0;
+  stack[top++] = this;
+
+  while (top > 0) {
+    const BasicOctreeNode *node = stack[--top];
+    if (node->totalMass == 0.0f)
+      continue;
+
+    if (node->isLeaf) {
+      for (const Body *body : node->bodies) {
+        if (body == &target)
+          continue;
+        target.applyGravity(*body, G);
+        counters.bodyBody++;
+      }
+      continue;
+    }
+
+    if (acceptsCell(node->centerOfMass, node->size, node->centerOffset,
+                    node->totalMass, targetPoint, opening)) {
+      applyMonopole(target, targetPoint, node->centerOfMass, node->totalMass,
+                    G);
+      if (expansionOrder >= 2)
+        applyQuadrupole(target, targetPoint, node->centerOfMass,
+                        node->quadrupole, G);
+      counters.bodyCell++;
+      continue;
+    }
+
+    counters.nodesOpened++;
+    for (int i = CHILD_COUNT - 1; i >= 0; i--) {
+      if (node->children[i] != nullptr)
+        stack[top++] = node->children[i].get();
+    }
   }
-  if (!isLeaf) {
-    if (shouldUseApproximation(target.position, theta)) {
-      glm::vec3 direction = centerOfMass - target.position;
-      float distance = glm::length(direction);
+}
 
-      if (distance < 0.1f)
-        distance = 0.1f;
+// same traversal and softening floor as the force walk, summed in double
+// since it only feeds diagnostics
+template <typename P, int Dim>
+double BasicOctreeNode<P, Dim>::calculatePotential(const Body &target, float G,
+                                                   float theta) const {
+  Point targetPoint = project(target.position);
+  const BasicOctreeNode *stack[OCTREE_WALK_STACK_SIZE];
+  int top = 0;
+  stack[top++] = this;
+  double potential = 0.0;
 
-      direction = glm::normalize(direction);
-      float forceMagnitude =
-          G * target.mass * totalMass / (distance * distance);
-      target.acceleration += direction * (forceMagnitude / target.mass);
-    } else {
-      for (int i = 0; i < 8; i++) {
-        if (children[i] != nullptr)
-          children[i]->calculateForce(target, G, theta);
+  while (top > 0) {
+    const BasicOctreeNode *node = stack[--top];
+    if (node->totalMass == 0.0f)
+      continue;
+
+    if (node->isLeaf) {
+      for (const Body *body : node->bodies) {
+        if (body == &target)
+          continue;
+        glm::dvec3 offset(body->position - target.position);
+        double distance = std::max(glm::length(offset), 0.1);
+        potential -= (double)G * body->mass / distance;
       }
+      continue;
+    }
+
+    if (node->shouldUseApproximation(targetPoint, theta)) {
+      glm::vec<Dim, double> offset(node->centerOfMass - targetPoint);
+      double distance = std::max(glm::length(offset), 0.1);
+      potential -= (double)G * node->totalMass / distance;
+      continue;
+    }
+
+    for (int i = CHILD_COUNT - 1; i >= 0; i--) {
+      if (node->children[i] != nullptr)
+        stack[top++] = node->children[i].get();
     }
   }
+  return potential;
 }
 
-void OctreeNode::updateMassProperties() {
-  if (isLeaf && body != nullptr) {
-    totalMass = body->mass;
-    centerOfMass = body->position;
-  } else if (!isLeaf) {
-    totalMass = 0.0f;
-    glm::vec3 weightedPosition(0.0f);
+// moments of this node from its bodies or its children's moments
+template <typename P, int Dim>
+void BasicOctreeNode<P, Dim>::combineMassProperties() {
+  totalMass = 0.0f;
+  Point weightedPosition(0.0f);
 
-    for (int i = 0; i < 8; i++) {
-      if (children[i] != nullptr && children[i]->totalMass > 0.0f) {
+  if (isLeaf) {
+    for (const Body *body : bodies) {
+      totalMass += body->mass;
+      weightedPosition += project(body->position) * body->mass;
+    }
+  } else {
+    for (int i = 0; i < CHILD_COUNT; i++) {
+      if (children[i] == nullptr)
+        continue;
+      if (children[i]->totalMass > 0.0f) {
         totalMass += children[i]->totalMass;
         weightedPosition += children[i]->centerOfMass * children[i]->totalMass;
       }
     }
-    if (totalMass > 0.0f)
-      centerOfMass = weightedPosition / totalMass;
-    else
-      centerOfMass = center;
+  }
+
+  if (totalMass > 0.0f)
+    centerOfMass = weightedPosition / totalMass;
+  else
+    centerOfMass = center;
+  centerOffset = glm::length(centerOfMass - center);
+
+  for (int i = 0; i < QUADRUPOLE_SIZE; i++)
+    quadrupole[i] = 0.0f;
+
+  if (isLeaf) {
+    for (const Body *body : bodies)
+      addPointQuadrupole<Dim>(quadrupole,
+                              project(body->position) - centerOfMass,
+                              body->mass);
+  } else {
+    // parallel axis theorem: shift each child's moment to our centerOfMass
+    for (int i = 0; i < CHILD_COUNT; i++) {
+      if (children[i] == nullptr || children[i]->totalMass <= 0.0f)
+        continue;
+      for (int k = 0; k < QUADRUPOLE_SIZE; k++)
+        quadrupole[k] += children[i]->quadrupole[k];
+      addPointQuadrupole<Dim>(quadrupole,
+                              children[i]->centerOfMass - centerOfMass,
+                              children[i]->totalMass);
+    }
   }
 }
 
-void OctreeNode::clear() {
+template <typename P, int Dim> void BasicOctreeNode<P, Dim>::clear() {
   totalMass = 0.0f;
-  centerOfMass = glm::vec3(0.0f);
-  body = nullptr;
+  centerOfMass = Point(0.0f);
+  centerOffset = 0.0f;
+  for (int i = 0; i < QUADRUPOLE_SIZE; i++)
+    quadrupole[i] = 0.0f;
+  bodies.clear();
   isLeaf = true;
 
-  for (int i = 0; i < 8; i++)
+  for (int i = 0; i < CHILD_COUNT; i++)
     children[i] = nullptr;
 }
 
-int OctreeNode::getOctant(const glm::vec3 &position) const {
+// bit k of the octant is set when the position is at or above the centre
+// on the tree's k-th axis
+template <typename P, int Dim>
+int BasicOctreeNode<P, Dim>::getOctant(const Point &position) const {
   int octant = 0;
-  if (position.x >= center.x)
-    octant |= 1;
-  if (position.y >= center.y)
-    octant |= 2;
-  if (position.z >= center.z)
-    octant |= 4;
-
+  for (int k = 0; k < Dim; k++) {
+    if (position[k] >= center[k])
+      octant |= 1 << k;
+  }
   return octant;
 }
 
-glm::vec3 OctreeNode::getOctantCenter(int octant) const {
-  float halfSize = size * 0.5f;
-  float quarterSize = size * 0.25f;
-
-  glm::vec3 octantCenter = center;
+template <typename P, int Dim>
+typename BasicOctreeNode<P, Dim>::Point
+BasicOctreeNode<P, Dim>::getOctantCenter(int octant) const {
+  Real quarterSize = size * Real(0.25f);
 
-  octantCenter.x += (octant & 1) ? quarterSize : -quarterSize;
-  octantCenter.y += (octant & 2) ? quarterSize : -quarterSize;
-  octantCenter.z += (octant & 4) ? quarterSize : -quarterSize;
+  Point octantCenter = center;
+  for (int k = 0; k < Dim; k++)
+    octantCenter[k] += (octant & (1 << k)) ? quarterSize : -quarterSize;
 
   return octantCenter;
 }
 
-bool OctreeNode::contains(const glm::vec3 &position) const {
-  float halfSize = size * 0.5f;
-  return (
-      position.x >= center.x - halfSize && position.x < center.x + halfSize &&
-      position.y >= center.y - halfSize && position.y < center.y + halfSize &&
-      position.z >= center.z - halfSize && position.z < center.z + halfSize);
+template <typename P, int Dim>
+bool BasicOctreeNode<P, Dim>::contains(const Point &position) const {
+  Real halfSize = size * Real(0.5f);
+  for (int k = 0; k < Dim; k++) {
+    if (!(position[k] >= center[k] - halfSize &&
+          position[k] < center[k] + halfSize))
+      return false;
+  }
+  return true;
+}
+
+template <typename P, int Dim>
+bool BasicOctreeNode<P, Dim>::shouldSplit(size_t count) const {
+  return (int)count > limits.leafCapacity &&
+         depth < std::min(limits.maxDepth, OCTREE_DEPTH_LIMIT) &&
+         size >= limits.minSize;
 }
 
-void OctreeNode::subdivide() {
-  float childSize = size * 0.5f;
+template <typename P, int Dim> void BasicOctreeNode<P, Dim>::subdivide() {
+  Real childSize = size * Real(0.5f);
 
-  for (int i = 0; i < 8; i++) {
-    glm::vec3 childCenter = getOctantCenter(i);
-    children[i] =
-        std::make_unique<OctreeNode>(childCenter, childSize, depth + 1);
+  for (int i = 0; i < CHILD_COUNT; i++) {
+    Point childCenter = getOctantCenter(i);
+    children[i] = std::make_unique<BasicOctreeNode>(childCenter, childSize,
+                                                    depth + 1, limits);
   }
 }
 
-bool OctreeNode::shouldUseApproximation(const glm::vec3& targetPosition, float theta) const {
-	float distance = glm::length(centerOfMass - targetPosition);
+template <typename P, int Dim>
+size_t BasicOctreeNode<P, Dim>::memoryBytes() const {
+  size_t bytes = sizeof(BasicOctreeNode) + bodies.capacity() * sizeof(Body *);
+  for (int i = 0; i < CHILD_COUNT; i++) {
+    if (children[i] != nullptr)
+      bytes += children[i]->memoryBytes();
+  }
+  return bytes;
+}
 
-	if(distance < 0.1f)
-		return false;
+// depth-first, so bodies that are close in space end up close in the list
+template <typename P, int Dim>
+void BasicOctreeNode<P, Dim>::collectBodies(std::vector<Body *> &out) const {
+  if (isLeaf) {
+    out.insert(out.end(), bodies.begin(), bodies.end());
+    return;
+  }
 
-	return (size / distance) < theta;
+  for (int i = 0; i < CHILD_COUNT; i++) {
+    if (children[i] != nullptr)
+      children[i]->collectBodies(out);
+  }
 }
 
+template <typename P, int Dim>
+void BasicOctreeNode<P, Dim>::collectStats(OctreeStats &stats) const {
+  stats.nodeCount++;
+  stats.memoryBytes +=
+      sizeof(BasicOctreeNode) + bodies.capacity() * sizeof(Body *);
 
+  if ((int)stats.depthHistogram.size() <= depth)
+    stats.depthHistogram.resize(depth + 1, 0);
+  stats.depthHistogram[depth]++;
 
+  if (isLeaf) {
+    stats.leafCount++;
+    if (bodies.empty())
+      stats.emptyLeafCount++;
+    if (stats.leafOccupancy.size() <= bodies.size())
+      stats.leafOccupancy.resize(bodies.size() + 1, 0);
+    stats.leafOccupancy[bodies.size()]++;
+    return;
+  }
+
+  for (int i = 0; i < CHILD_COUNT; i++) {
+    if (children[i] != nullptr)
+      children[i]->collectStats(stats);
+  }
+}
+
+template <typename P, int Dim>
+bool BasicOctreeNode<P, Dim>::shouldUseApproximation(const Point& targetPosition, float theta) const {
+	return acceptsCell(centerOfMass, size, targetPosition, theta);
+}
 
+template class BasicOctreeNode<FloatPrecision, 3>;
+template class BasicOctreeNode<DoublePrecision, 3>;
+template class BasicOctreeNode<MixedPrecision, 3>;
+template class BasicOctreeNode<FloatPrecision, 2>;
+template class BasicOctreeNode<DoublePrecision, 2>;
+template class BasicOctreeNode<MixedPrecision, 2>;
@@ -0,0 +1,29 @@
+#include "include/precision.h"
+
+bool parsePrecisionMode(const std::string &name, PrecisionMode &mode) {
+  if (name == "float") {
+    mode = PrecisionMode::Float;
+    return true;
+  }
+  if (name == "double") {
+    mode = PrecisionMode::Double;
+    return true;
+  }
+  if (name == "mixed") {
+    mode = PrecisionMode::Mixed;
+    return true;
+  }
+  return false;
+}
+
+const char *precisionModeName(PrecisionMode mode) {
+  switch (mode) {
+  case PrecisionMode::Float:
+    return "float";
+  case PrecisionMode::Double:
+    return "double";
+  case PrecisionMode::Mixed:
+    return "mixed";
+  }
+  return "unknown";
+}
@@ -0,0 +1,131 @@
+#include "include/profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+static uint32_t currentThreadId() {
+  static std::atomic<uint32_t> nextThreadId(0);
+  thread_local uint32_t threadId = nextThreadId.fetch_add(1);
+  return threadId;
+}
+
+static const std::chrono::steady_clock::time_point profilerEpoch =
+    std::chrono::steady_clock::now();
+
+Profiler::Profiler() : enabled(false), writeIndex(0) {
+  for (auto &slot : slots)
+    slot.sequence.store(0, std::memory_order_relaxed);
+}
+
+Profiler &Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+void Profiler::setEnabled(bool value) {
+  enabled.store(value, std::memory_order_relaxed);
+}
+
+void Profiler::clear() {
+  for (auto &slot : slots)
+    slot.sequence.store(0, std::memory_order_relaxed);
+  writeIndex.store(0, std::memory_order_release);
+}
+
+// offset by one so that 0 can mean "not timing" in ScopedTimer
+uint64_t Profiler::now() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - profilerEpoch)
+             .count() +
+         1;
+}
+
+void Profiler::record(const char *name, uint64_t startNs, uint64_t endNs) {
+  uint64_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[index % PROFILER_RING_CAPACITY];
+
+  // sequence 0 while the slot is being written, index + 1 once complete
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event.name = name;
+  slot.event.startNs = startNs;
+  slot.event.durationNs = endNs - startNs;
+  slot.event.threadId = currentThreadId();
+  slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+size_t Profiler::collect(ProfileEvent *out) const {
+  uint64_t end = writeIndex.load(std::memory_order_acquire);
+  uint64_t begin =
+      end > PROFILER_RING_CAPACITY ? end - PROFILER_RING_CAPACITY : 0;
+
+  size_t count = 0;
+  for (uint64_t index = begin; index < end; index++) {
+    const Slot &slot = slots[index % PROFILER_RING_CAPACITY];
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+      continue;
+    ProfileEvent event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != index + 1)
+      continue;
+    out[count++] = event;
+  }
+  return count;
+}
+
+void Profiler::writeChromeTrace(std::ostream &out) const {
+  std::vector<ProfileEvent> events(PROFILER_RING_CAPACITY);
+  events.resize(collect(events.data()));
+
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (size_t i = 0; i < events.size(); i++) {
+    const ProfileEvent &event = events[i];
+    out << (i == 0 ? "\n" : ",\n");
+    char line[256];
+    snprintf(line, sizeof(line),
+             "  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+             "\"ts\": %.3f, \"dur\": %.3f}",
+             event.name, event.threadId, event.startNs / 1000.0,
+             event.durationNs / 1000.0);
+    out << line;
+  }
+  out << "\n]}\n";
+}
+
+void Profiler::printSummary(std::ostream &out) const {
+  struct PhaseSummary {
+    size_t count = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+  };
+
+  std::vector<ProfileEvent> events(PROFILER_RING_CAPACITY);
+  events.resize(collect(events.data()));
+
+  std::map<std::string, PhaseSummary> phases;
+  for (const ProfileEvent &event : events) {
+    PhaseSummary &phase = phases[event.name];
+    phase.count++;
+    phase.totalNs += event.durationNs;
+    phase.maxNs = std::max(phase.maxNs, event.durationNs);
+  }
+
+  std::vector<std::pair<std::string, PhaseSummary>> sorted(phases.begin(),
+                                                           phases.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.totalNs > b.second.totalNs;
+  });
+
+  out << "phase                     calls    total ms     mean ms      max ms\n";
+  for (const auto &entry : sorted) {
+    const PhaseSummary &phase = entry.second;
+    char line[128];
+    snprintf(line, sizeof(line), "%-24s %6zu %11.3f %11.4f %11.4f\n",
+             entry.first.c_str(), phase.count, phase.totalNs * 1e-6,
+             phase.totalNs * 1e-6 / phase.count, phase.maxNs * 1e-6);
+    out << line;
+  }
+}
@@ -0,0 +1,118 @@
+#include "include/sceneGenerator.h"
+#include <cmath>
+#include <random>
+
+bool parseSceneType(const std::string &name, SceneType &type) {
+  if (name == "disc") {
+    type = SceneType::Disc;
+    return true;
+  }
+  if (name == "flat-disc") {
+    type = SceneType::FlatDisc;
+    return true;
+  }
+  if (name == "plummer") {
+    type = SceneType::Plummer;
+    return true;
+  }
+  return false;
+}
+
+const char *sceneTypeName(SceneType type) {
+  switch (type) {
+  case SceneType::Disc:
+    return "disc";
+  case SceneType::FlatDisc:
+    return "flat-disc";
+  case SceneType::Plummer:
+    return "plummer";
+  }
+  return "unknown";
+}
+
+// same layout as Simulation::setupScene: fixed star, thin disc of orbiting
+// bodies and a thicker debris ring, scaled to any body count; flat keeps
+// the debris in the y = 0 plane too
+static void generateDisc(std::vector<CelestialBody> &bodies, size_t count,
+                         std::mt19937 &gen, float G, bool flat) {
+  const float starMass = 1000.0f;
+  bodies.emplace_back(glm::vec3(0.0f), glm::vec3(0.0f), starMass, true);
+
+  std::uniform_real_distribution<float> angleDis(0.0f, 2.0f * M_PI);
+  std::uniform_real_distribution<float> unitDis(0.0f, 1.0f);
+
+  for (size_t i = 1; i < count; i++) {
+    bool debris = unitDis(gen) < 0.7f;
+    float distance = debris ? 15.0f + 10.0f * unitDis(gen)
+                            : 8.0f + 800.0f * unitDis(gen);
+    float angle = angleDis(gen);
+    float speedFactor = debris ? 0.6f + 0.2f * unitDis(gen) : 0.75f;
+    float orbitalSpeed = sqrt(G * starMass / distance) * speedFactor;
+    float height = debris ? (unitDis(gen) - 0.5f) * 2.0f : 0.0f;
+    if (flat)
+      height = 0.0f;
+
+    glm::vec3 pos(distance * cos(angle), height, distance * sin(angle));
+    glm::vec3 vel(-orbitalSpeed * sin(angle), 0.0f, orbitalSpeed * cos(angle));
+
+    float mass = debris ? 0.1f : 0.5f + 2.0f * unitDis(gen);
+    bodies.emplace_back(pos, vel, mass);
+  }
+}
+
+// Plummer sphere with scale radius a: r = a / sqrt(u^(-2/3) - 1), velocities
+// from the isotropic distribution via rejection sampling
+static void generatePlummer(std::vector<CelestialBody> &bodies, size_t count,
+                            std::mt19937 &gen, float G) {
+  const float totalMass = 1000.0f;
+  const float scaleRadius = 50.0f;
+  float bodyMass = totalMass / (float)count;
+
+  std::uniform_real_distribution<float> unitDis(0.0f, 1.0f);
+  auto randomDirection = [&]() {
+    float z = 2.0f * unitDis(gen) - 1.0f;
+    float phi = 2.0f * M_PI * unitDis(gen);
+    float r = sqrt(1.0f - z * z);
+    return glm::vec3(r * cos(phi), z, r * sin(phi));
+  };
+
+  for (size_t i = 0; i < count; i++) {
+    float u = glm::max(unitDis(gen), 1e-6f);
+    float radius = scaleRadius / sqrt(pow(u, -2.0f / 3.0f) - 1.0f);
+    radius = glm::min(radius, 20.0f * scaleRadius);
+
+    float q, g;
+    do {
+      q = unitDis(gen);
+      g = 0.1f * unitDis(gen);
+    } while (g > q * q * pow(1.0f - q * q, 3.5f));
+
+    float escapeSpeed =
+        sqrt(2.0f * G * totalMass) *
+        pow(radius * radius + scaleRadius * scaleRadius, -0.25f);
+
+    bodies.emplace_back(radius * randomDirection(),
+                        q * escapeSpeed * randomDirection(), bodyMass);
+  }
+}
+
+void generateScene(std::vector<CelestialBody> &bodies, SceneType type,
+                   size_t count, unsigned int seed, float G) {
+  bodies.clear();
+  bodies.reserve(count);
+  if (count == 0)
+    return;
+
+  std::mt19937 gen(seed);
+  switch (type) {
+  case SceneType::Disc:
+    generateDisc(bodies, count, gen, G, false);
+    break;
+  case SceneType::FlatDisc:
+    generateDisc(bodies, count, gen, G, true);
+    break;
+  case SceneType::Plummer:
+    generatePlummer(bodies, count, gen, G);
+    break;
+  }
+}
@@ -1,14 +1,26 @@
 #include "include/simulation.h"
-#include "include/octreeNode.h"
+#include "include/cpuFeatures.h"
+#include "include/profiler.h"
+#include "include/snapshot.h"
+#include "include/spatialSort.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <glm/ext/vector_float3.hpp>
 #include <glm/geometric.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
-#include <limits>
-#include <memory>
 #include <random>
+#include <sstream>
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
 
 const char *Simulation::vertexShaderSource = R"(
 #version 330 core
@@ -77,24 +89,31 @@ const char *Simulation::trajectoryFragmentShaderSource = R"(
 )";
 
 Simulation::Simulation()
-    : G(DEFAULT_GRAVITATIONAL_CONSTANT),
+    : monitorConservation(false), G(DEFAULT_GRAVITATIONAL_CONSTANT),
       cameraDistance(DEFAULT_CAMERA_DISTANCE), cameraAngle(0.0f), paused(false),
       timeScale(DEFAULT_TIME_SCALE), showTrajectories(false),
-      useBarnesHut(true), trajectoryUpdateCounter(0), spaceMin(-1000.0f),
-      spaceMax(1000.f) {
+      trajectoryUpdateCounter(0), reorderCounter(0),
+      simulationTime(0.0), snapshotCounter(0),
+      escapeRadius(DEFAULT_ESCAPE_RADIUS) {
   setupShaders();
   setupGeometry();
   setupTrajectoryGeometry();
   setupScene();
-
-  calculateBounds();
-  glm::vec3 center = (spaceMin + spaceMax) * 0.5f;
-  float size = glm::length(spaceMax - spaceMin);
-  octreeRoot = std::make_unique<OctreeNode>(center, size);
-
-  std::cout << "Barnes-Hut algorithm initialized\n";
-  std::cout << "Press 'B' to toggle between Barnes-Hut and N-body "
-               "calculation\n";
+  engine.tuningCache = &tuningCache;
+  conservation.onAlert = [](const ConservationSample &sample,
+                            const ConservationDrift &drift) {
+    std::cerr << "conservation drift at t=" << sample.time << ": energy "
+              << drift.energy << ", momentum " << drift.momentum
+              << ", angular momentum " << drift.angularMomentum << "\n";
+  };
+  setBaseTheta(engine.barnesHut.theta);
+  applyCachedTuning();
+
+  std::cout << "Barnes-Hut algorithm initialized, "
+            << isaLevelName(activeIsaLevel()) << " kernels\n";
+  std::cout << "Press 'B' to cycle between automatic engine selection, "
+               "Barnes-Hut and N-body calculation, 'U' to tune Barnes-Hut for this machine, 'G' to "
+               "toggle the frame-budget governor\n";
 }
 
 Simulation::~Simulation() {
@@ -174,7 +193,7 @@ void Simulation::setupTrajectoryGeometry() {
   glBindVertexArray(trajectoryVAO);
   glBindBuffer(GL_ARRAY_BUFFER, trajectoryVBO);
   glBufferData(GL_ARRAY_BUFFER,
-               CelestialBody::MAX_TRAJECTORY_POINTS * 3 * sizeof(float), NULL,
+               BodyVisual::MAX_TRAJECTORY_POINTS * 3 * sizeof(float), NULL,
                GL_DYNAMIC_DRAW);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
   glEnableVertexAttribArray(0);
@@ -182,8 +201,8 @@ void Simulation::setupTrajectoryGeometry() {
 
 void Simulation::setupScene() {
   // central object fixed (e.g., sun)
-  bodies.emplace_back(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f), 1000.0f,
-                      5.0f, glm::vec3(1.0f, 1.0f, 0.0f), true);
+  bodyPool.add(CelestialBody(glm::vec3(0.0f), glm::vec3(0.0f), 1000.0f, true),
+               BodyVisual(glm::vec3(1.0f, 1.0f, 0.0f), 5.0f));
 
   // random objects to orbit around the central object
   std::random_device rd;
@@ -199,8 +218,9 @@ void Simulation::setupScene() {
     glm::vec3 pos(distance * cos(angle), 0.0f, distance * sin(angle));
     glm::vec3 vel(-orbitalSpeed * sin(angle), 0.0f, orbitalSpeed * cos(angle));
 
-    bodies.emplace_back(pos, vel, 1.0f + i * 0.5f, 0.3f + i * 0.1f,
-                        glm::vec3(0.3f + i * 0.2f, 0.5f, 1.0f - i * 0.2f));
+    bodyPool.add(CelestialBody(pos, vel, 1.0f + i * 0.5f),
+                 BodyVisual(glm::vec3(0.3f + i * 0.2f, 0.5f, 1.0f - i * 0.2f),
+                            0.3f + i * 0.1f));
   }
 
   // outer objects -> slower and longer orbits
@@ -212,8 +232,9 @@ void Simulation::setupScene() {
     glm::vec3 pos(distance * cos(angle), 0.0f, distance * sin(angle));
     glm::vec3 vel(-orbitalSpeed * sin(angle), 0.0f, orbitalSpeed * cos(angle));
 
-    bodies.emplace_back(pos, vel, 0.5f + i * 0.3f, 0.2f + i * 0.1f,
-                        glm::vec3(1.0f - i * 0.2f, 0.3f + i * 0.2f, 0.5f));
+    bodyPool.add(CelestialBody(pos, vel, 0.5f + i * 0.3f),
+                 BodyVisual(glm::vec3(1.0f - i * 0.2f, 0.3f + i * 0.2f, 0.5f),
+                            0.2f + i * 0.1f));
   }
 
   // objects between inner and outer objects (small debris)
@@ -228,107 +249,178 @@ void Simulation::setupScene() {
                   distance * sin(angle));
     glm::vec3 vel(-orbitalSpeed * sin(angle), 0.0f, orbitalSpeed * cos(angle));
 
-    bodies.emplace_back(pos, vel, 0.1f, 0.05f, glm::vec3(0.6f, 0.6f, 0.6f));
+    bodyPool.add(CelestialBody(pos, vel, 0.1f),
+                 BodyVisual(glm::vec3(0.6f, 0.6f, 0.6f), 0.05f));
   }
-  calculateBounds();
 }
 
-void Simulation::calculateBounds() {
-  if (bodies.empty()) {
-    spaceMin = glm::vec3(-1000.0f);
-    spaceMax = glm::vec3(1000.0f);
+void Simulation::updateGravity() {
+  engine.computeAccelerations(bodyPool.bodies, G);
+}
+
+void Simulation::update(float deltaTime) {
+  framePhases.physicsMs = 0.0;
+  framePhases.trailMs = 0.0;
+  if (paused)
     return;
-  }
 
-  spaceMin = glm::vec3(std::numeric_limits<float>::max());
-  spaceMax = glm::vec3(std::numeric_limits<float>::lowest());
+  PROFILE_SCOPE("step");
+  auto physicsStart = std::chrono::steady_clock::now();
+  const FidelitySettings &fidelity = governor.settings();
+  float dt = deltaTime * timeScale;
+  simulationTime += dt;
+
+  if (escapeRadius > 0.0f)
+    bodyPool.removeBeyond(glm::vec3(0.0f), escapeRadius);
 
-  for (const auto &body : bodies) {
-    spaceMin = glm::min(spaceMin, body.position);
-    spaceMax = glm::max(spaceMax, body.position);
+  if (++reorderCounter >= BODY_REORDER_INTERVAL) {
+    reorderCounter = 0;
+    reorderBodies();
+  } else if (bodyPool.needsCompaction()) {
+    compactBodies();
   }
 
-  glm::vec3 padding = (spaceMax - spaceMin) * 0.2f;
-  spaceMax -= padding;
-  spaceMax += padding;
+  engine.barnesHut.theta = fidelity.theta;
+  float stepDt = dt / fidelity.substeps;
+  for (int step = 0; step < fidelity.substeps; step++) {
+    updateGravity();
 
-  glm::vec3 size = spaceMax - spaceMin;
-  float minSize = 100.f;
-  if (glm::length(size) < minSize) {
-    glm::vec3 center = (spaceMin + spaceMax) * 0.5f;
-    spaceMin = center - glm::vec3(minSize * 0.5f);
-    spaceMax = center + glm::vec3(minSize * 0.5f);
+    PROFILE_SCOPE("integrate");
+    integrateBodies(bodyPool.bodies, stepDt);
   }
-}
+  if (monitorConservation)
+    conservation.observe(bodyPool.bodies, G, simulationTime);
+  framePhases.physicsMs = millisecondsSince(physicsStart);
 
-void Simulation::buildOctree() {
-  calculateBounds();
-  glm::vec3 center = (spaceMin + spaceMax) * 0.5f;
-  float size = glm::length(spaceMax - spaceMin);
-  octreeRoot = std::make_unique<OctreeNode>(center, size);
+  // update trajectories
+  trajectoryUpdateCounter++;
+  if (trajectoryUpdateCounter >= fidelity.trailInterval) {
+    PROFILE_SCOPE("recordTrails");
+    auto trailStart = std::chrono::steady_clock::now();
+    trajectoryUpdateCounter = 0;
+    for (size_t i = 0; i < bodyPool.bodies.size(); i++) {
+      const CelestialBody &body = bodyPool.bodies[i];
+      if (!body.isFixed() && body.isActive())
+        bodyPool.visuals[i].addTrajectoryPoint(body.position);
+    }
+    framePhases.trailMs = millisecondsSince(trailStart);
+  }
+}
 
-  for (auto &body : bodies)
-    octreeRoot->insertBody(&body);
+// keeps bodies that are close in space close in memory, so consecutive
+// targets share most of their tree walk in cache
+void Simulation::reorderBodies() {
+  compactBodies();
 
-  octreeRoot->updateMassProperties();
+  PROFILE_SCOPE("reorderBodies");
+  std::vector<size_t> order = mortonOrder(bodyPool.bodies);
+  bodyPool.permute(order);
+  engine.permuteBodyData(order);
 }
 
-void Simulation::updateGravityBarnesHut() {
-  buildOctree();
+void Simulation::compactBodies() {
+  if (bodyPool.freeCount() == 0)
+    return;
 
-  for (auto &body : bodies) {
-    if (!body.isFixed) {
-      body.acceleration = glm::vec3(0.0f);
-      octreeRoot->calculateForce(body, G, BARNES_HUT_THETA);
-    }
-  }
+  PROFILE_SCOPE("compactBodies");
+  std::vector<size_t> order = bodyPool.compact();
+  engine.permuteBodyData(order);
 }
 
-void Simulation::updateGravityDirect() {
-  for (size_t i = 0; i < bodies.size(); i++) {
-    if (!bodies[i].isFixed)
-      bodies[i].acceleration = glm::vec3(0.0f);
+uint64_t Simulation::addBody(const CelestialBody &body) {
+  uint64_t id = bodyPool.add(body);
+  // the slot may be a removed body's, whose step costs the engine still has
+  engine.resetBodyData(bodyPool.ids.slotOf(id));
+  return id;
+}
 
-    for (size_t j = 0; j < bodies.size(); j++) {
-      if (i != j)
-        bodies[i].applyGravity(bodies[j], G);
-    }
-  }
+bool Simulation::removeBody(uint64_t id) { return bodyPool.remove(id); }
+
+void Simulation::saveSnapshot() {
+  char path[64];
+  snprintf(path, sizeof(path), SNAPSHOT_FILE_PREFIX "%04d.csv",
+           snapshotCounter++);
+  if (writeSnapshot(path, bodyPool.bodies, simulationTime))
+    std::cout << "Snapshot written to " << path << "\n";
+  else
+    std::cerr << "failed to write snapshot " << path << "\n";
 }
 
-void Simulation::update(float deltaTime) {
-  if (paused)
+void Simulation::applyCachedTuning() {
+  TuningProfile profile;
+  if (!tuningCache.load() || !tuningCache.find(bodyCount(), profile))
     return;
+  profile.applyTo(engine.barnesHut);
+  engine.threadCount = profile.threadCount;
+  setBaseTheta(profile.theta);
+  std::cout << "Using tuned Barnes-Hut profile: theta " << profile.theta
+            << ", leaf " << profile.leafCapacity << ", "
+            << profile.threadCount << " threads\n";
+}
 
-  float dt = deltaTime * timeScale;
+// blocks the viewer while it runs, the scene is small enough for that
+void Simulation::tuneBarnesHut() {
+  std::cout << "Tuning Barnes-Hut for " << bodyCount() << " bodies...\n";
+  std::vector<CelestialBody> active;
+  for (const CelestialBody &body : bodyPool.bodies) {
+    if (body.isActive())
+      active.push_back(body);
+  }
 
-  if (useBarnesHut)
-    updateGravityBarnesHut();
-  else
-    updateGravityDirect();
+  TuningProfile profile = autoTune(active, G);
+  profile.applyTo(engine.barnesHut);
+  engine.threadCount = profile.threadCount;
+  setBaseTheta(profile.theta);
+  tuningCache.store(active.size(), profile);
+  engine.reselect();
+  if (!tuningCache.save())
+    std::cerr << "failed to write " << tuningCache.filePath() << "\n";
+  std::cout << "Tuned: theta " << profile.theta << ", leaf "
+            << profile.leafCapacity << ", order " << profile.expansionOrder
+            << ", " << profile.threadCount << " threads, "
+            << profile.stepMs << " ms per step, p99 error "
+            << profile.p99Error << "\n";
+}
 
-  for (auto &body : bodies) {
-    body.update(dt);
-  }
+// the governor only ever loosens theta from here
+void Simulation::setBaseTheta(float theta) {
+  governor.bounds.minTheta = theta;
+  governor.bounds.maxTheta = std::max(governor.bounds.maxTheta, theta);
+  governor.reset();
+}
 
-  // update trajectories
-  trajectoryUpdateCounter++;
-  if (trajectoryUpdateCounter >= 1) {
-    trajectoryUpdateCounter = 0;
-    for (auto &body : bodies) {
-      if (!body.isFixed)
-        body.addTrajectoryPoint();
-    }
-  }
+std::string Simulation::statusSummary() const {
+  const FidelitySettings &fidelity = governor.settings();
+  std::ostringstream summary;
+  summary << engineChoiceName(engine.choice);
+  if (engine.choice == EngineChoice::Auto)
+    summary << " (" << engine.current().name() << ")";
+  summary << ", ";
+  if (monitorConservation && conservation.hasSample())
+    summary << "energy drift " << conservation.drift().energy << ", ";
+  if (!governor.isEnabled())
+    summary << "governor off, ";
+  summary << "fidelity " << (int)std::lround(governor.fidelity() * 100.0f)
+          << "% (theta " << fidelity.theta << ", " << fidelity.substeps
+          << " substeps, trail every " << fidelity.trailInterval
+          << ", drawing 1/" << fidelity.renderStride << ")";
+  return summary.str();
 }
 
 void Simulation::render(int width, int height) {
+  PROFILE_SCOPE("render");
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   updateCamera(width, height);
+  int stride = governor.settings().renderStride;
 
-  if (showTrajectories)
+  if (showTrajectories) {
+    auto trailStart = std::chrono::steady_clock::now();
     renderTrajectories();
+    framePhases.trailMs += millisecondsSince(trailStart);
+  }
+
+  auto renderStart = std::chrono::steady_clock::now();
 
   glUseProgram(shaderProgram);
 
@@ -343,21 +435,28 @@ void Simulation::render(int width, int height) {
 
   glBindVertexArray(VAO);
 
-  for (const auto &body : bodies) {
+  for (size_t i = 0; i < bodyPool.bodies.size(); i++) {
+    const CelestialBody &body = bodyPool.bodies[i];
+    const BodyVisual &visual = bodyPool.visuals[i];
+    // by id, which reordering and compaction leave alone, so the same
+    // bodies stay drawn
+    if (!body.isActive() || (!body.isFixed() && body.id % stride != 0))
+      continue;
+
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, body.position);
-    model = glm::scale(model, glm::vec3(body.radius));
+    model = glm::scale(model, glm::vec3(visual.radius));
 
     glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1,
                        GL_FALSE, glm::value_ptr(model));
 
     float distance = glm::length(body.position - getCameraPosition());
-    float pointSize = (body.radius * POINT_SCALE_SIZE) / distance;
+    float pointSize = (visual.radius * POINT_SCALE_SIZE) / distance;
     pointSize = glm::clamp(pointSize, MIN_POINT_SIZE, MAX_POINT_SIZE);
     glPointSize(pointSize);
 
-    float colorData[] = {0.0f,         0.0f,         0.0f,
-                         body.color.r, body.color.g, body.color.b};
+    float colorData[] = {0.0f,           0.0f,           0.0f,
+                         visual.color.r, visual.color.g, visual.color.b};
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(colorData), colorData);
 
@@ -365,6 +464,11 @@ void Simulation::render(int width, int height) {
   }
 
   glDisable(GL_BLEND);
+  framePhases.renderMs = millisecondsSince(renderStart);
+
+  if (governor.isEnabled())
+    renderFidelityIndicator();
+  governor.recordFrame(framePhases);
 }
 
 void Simulation::renderTrajectories() {
@@ -380,13 +484,16 @@ void Simulation::renderTrajectories() {
   glLineWidth(2.0f);
 
   glBindVertexArray(trajectoryVAO);
+  int stride = governor.settings().renderStride;
 
-  for (const auto &body : bodies) {
-    if (body.isFixed || body.trajectory.size() < 2)
+  for (size_t i = 0; i < bodyPool.bodies.size(); i++) {
+    const BodyVisual &visual = bodyPool.visuals[i];
+    if (bodyPool.bodies[i].isFixed() || visual.trajectory.size() < 2 ||
+        bodyPool.bodies[i].id % stride != 0)
       continue;
 
     std::vector<float> trajectoryData;
-    for (const auto &point : body.trajectory) {
+    for (const auto &point : visual.trajectory) {
       trajectoryData.push_back(point.x);
       trajectoryData.push_back(point.y);
       trajectoryData.push_back(point.z);
@@ -398,14 +505,50 @@ void Simulation::renderTrajectories() {
     glBufferSubData(GL_ARRAY_BUFFER, 0, trajectoryData.size() * sizeof(float),
                     trajectoryData.data());
 
-    glm::vec3 trajectoryColor = body.color * 0.3f + glm::vec3(0.1f);
+    glm::vec3 trajectoryColor = visual.color * 0.3f + glm::vec3(0.1f);
     glUniform3f(glGetUniformLocation(trajectoryShaderProgram, "color"),
                 trajectoryColor.r, trajectoryColor.g, trajectoryColor.b);
     glUniform1f(glGetUniformLocation(trajectoryShaderProgram, "alpha"), 0.2f);
 
-    glDrawArrays(GL_LINE_STRIP, 0, body.trajectory.size());
+    glDrawArrays(GL_LINE_STRIP, 0, visual.trajectory.size());
+  }
+  glDisable(GL_BLEND);
+}
+
+// a bar in screen space whose length and colour follow the fidelity, over a
+// dim track showing the full range
+void Simulation::renderFidelityIndicator() {
+  glm::mat4 identity(1.0f);
+  glUseProgram(trajectoryShaderProgram);
+  glUniformMatrix4fv(glGetUniformLocation(trajectoryShaderProgram, "view"), 1,
+                     GL_FALSE, glm::value_ptr(identity));
+  glUniformMatrix4fv(
+      glGetUniformLocation(trajectoryShaderProgram, "projection"), 1, GL_FALSE,
+      glm::value_ptr(identity));
+
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glLineWidth(6.0f);
+  glBindVertexArray(trajectoryVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, trajectoryVBO);
+
+  float fidelity = governor.fidelity();
+  float ends[2] = {FIDELITY_BAR_WIDTH, FIDELITY_BAR_WIDTH * fidelity};
+  glm::vec3 colors[2] = {glm::vec3(0.3f),
+                         glm::vec3(1.0f - fidelity, fidelity, 0.2f)};
+  for (int bar = 0; bar < 2; bar++) {
+    float line[] = {FIDELITY_BAR_X, FIDELITY_BAR_Y, 0.0f,
+                    FIDELITY_BAR_X + ends[bar], FIDELITY_BAR_Y, 0.0f};
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(line), line);
+    glUniform3f(glGetUniformLocation(trajectoryShaderProgram, "color"),
+                colors[bar].r, colors[bar].g, colors[bar].b);
+    glUniform1f(glGetUniformLocation(trajectoryShaderProgram, "alpha"), 0.8f);
+    glDrawArrays(GL_LINES, 0, 2);
   }
+
   glDisable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
 }
 
 void Simulation::updateCamera(int width, int height) {
@@ -435,6 +578,11 @@ void Simulation::handleInput(GLFWwindow *window) {
   static bool tPressed = false;
   static bool rPressed = false;
   static bool bPressed = false;
+  static bool pPressed = false;
+  static bool oPressed = false;
+  static bool uPressed = false;
+  static bool gPressed = false;
+  static bool ePressed = false;
 
   // Toggle pause
   if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && !spacePressed) {
@@ -451,15 +599,72 @@ void Simulation::handleInput(GLFWwindow *window) {
   } else if (glfwGetKey(window, GLFW_KEY_T) == GLFW_RELEASE)
     tPressed = false;
 
-  // Toggle algorithm
+  // Cycle algorithm
   if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS && !bPressed) {
-    useBarnesHut = !useBarnesHut;
-    std::cout << "Using " << (useBarnesHut ? "Barnes-Hut" : "n-body")
-              << " algoritm\n";
+    // auto -> barnes-hut -> direct -> auto
+    if (engine.choice == EngineChoice::Auto)
+      engine.choice = EngineChoice::BarnesHut;
+    else if (engine.choice == EngineChoice::BarnesHut)
+      engine.choice = EngineChoice::Direct;
+    else
+      engine.choice = EngineChoice::Auto;
+    std::cout << "Using " << engineChoiceName(engine.choice)
+              << " algorithm\n";
     bPressed = true;
   } else if (glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE)
     bPressed = false;
 
+  // Toggle profiler, dump trace and summary when stopping
+  if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !pPressed) {
+    Profiler &profiler = Profiler::instance();
+    if (!profiler.isEnabled()) {
+      profiler.clear();
+      profiler.setEnabled(true);
+      std::cout << "Profiler started\n";
+    } else {
+      profiler.setEnabled(false);
+      profiler.printSummary(std::cout);
+      std::ofstream trace(PROFILER_TRACE_FILE);
+      profiler.writeChromeTrace(trace);
+      std::cout << "Trace written to " << PROFILER_TRACE_FILE << "\n";
+    }
+    pPressed = true;
+  } else if (glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
+    pPressed = false;
+
+  // Snapshot of every body keyed by its stable id
+  if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !oPressed) {
+    saveSnapshot();
+    oPressed = true;
+  } else if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+    oPressed = false;
+
+  // Tune Barnes-Hut on the current scene and cache the profile
+  if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS && !uPressed) {
+    tuneBarnesHut();
+    uPressed = true;
+  } else if (glfwGetKey(window, GLFW_KEY_U) == GLFW_RELEASE)
+    uPressed = false;
+
+  // Toggle the frame-budget governor, off runs at full fidelity
+  if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !gPressed) {
+    governor.setEnabled(!governor.isEnabled());
+    std::cout << "Frame-budget governor "
+              << (governor.isEnabled() ? "on" : "off") << "\n";
+    gPressed = true;
+  } else if (glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE)
+    gPressed = false;
+
+  // Toggle the conservation monitor, each start takes a new baseline
+  if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS && !ePressed) {
+    monitorConservation = !monitorConservation;
+    conservation.reset();
+    std::cout << "Conservation monitor "
+              << (monitorConservation ? "on" : "off") << "\n";
+    ePressed = true;
+  } else if (glfwGetKey(window, GLFW_KEY_E) == GLFW_RELEASE)
+    ePressed = false;
+
   // WASD
   if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
     timeScale = glm::min(timeScale * 1.1f, 10.0f);
@@ -476,8 +681,13 @@ void Simulation::handleInput(GLFWwindow *window) {
   }
 
   if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS && !rPressed) {
-    bodies.clear();
+    bodyPool.clear();
+    simulationTime = 0.0;
     setupScene();
+    // the new scene reuses the old one's slots
+    for (size_t i = 0; i < bodyPool.bodies.size(); i++)
+      engine.resetBodyData(i);
+    conservation.reset();
     rPressed = true;
   } else if (glfwGetKey(window, GLFW_KEY_R) == GLFW_RELEASE)
     rPressed = false;
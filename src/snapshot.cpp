@@ -0,0 +1,38 @@
+#include "include/snapshot.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+bool writeSnapshot(const std::string &path,
+                   const std::vector<CelestialBody> &bodies, double time) {
+  std::ofstream out(path);
+  if (!out)
+    return false;
+
+  out << "# time " << time << "\n";
+  out << "id,x,y,z,vx,vy,vz,mass,fixed\n";
+
+  // rows in id order so snapshots diff cleanly across reorders
+  std::vector<const CelestialBody *> sorted;
+  sorted.reserve(bodies.size());
+  for (const auto &body : bodies) {
+    if (body.isActive())
+      sorted.push_back(&body);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const CelestialBody *a, const CelestialBody *b) {
+              return a->id < b->id;
+            });
+
+  char line[256];
+  for (const CelestialBody *bodyPtr : sorted) {
+    const CelestialBody &body = *bodyPtr;
+    snprintf(line, sizeof(line),
+             "%llu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%d\n",
+             (unsigned long long)body.id, body.position.x, body.position.y,
+             body.position.z, body.velocity.x, body.velocity.y,
+             body.velocity.z, body.mass, body.isFixed() ? 1 : 0);
+    out << line;
+  }
+  return (bool)out;
+}
@@ -0,0 +1,97 @@
+#include "include/spatialSort.h"
+#include "include/cpuFeatures.h"
+#include <algorithm>
+#include <limits>
+#if ISA_MULTIVERSION
+#include <immintrin.h>
+#endif
+
+// spreads the low 21 bits of v so that there are two zero bits between
+// consecutive bits
+static uint64_t expandBits(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+// written so that NaN lands in cell 0 instead of an undefined conversion
+static uint32_t quantize(float cell) {
+  const float maxCell = (float)((1u << MORTON_BITS_PER_AXIS) - 1);
+  if (!(cell > 0.0f))
+    return 0;
+  if (cell >= maxCell)
+    return (uint32_t)maxCell;
+  return (uint32_t)cell;
+}
+
+#if ISA_MULTIVERSION
+// one pdep per axis scatters the bits straight into place
+ISA_TARGET_BMI2 static uint64_t interleaveBitsBmi2(uint32_t x, uint32_t y,
+                                                   uint32_t z) {
+  const uint64_t mask = 0x1249249249249249ULL;
+  return _pdep_u64(x, mask) | _pdep_u64(y, mask << 1) |
+         _pdep_u64(z, mask << 2);
+}
+#endif
+
+// pdep at the Avx2 level and above, the same keys as the bit spread
+uint64_t interleaveBits(uint32_t x, uint32_t y, uint32_t z) {
+#if ISA_MULTIVERSION
+  if (activeIsaLevel() >= IsaLevel::Avx2)
+    return interleaveBitsBmi2(x, y, z);
+#endif
+  return expandBits(x) | expandBits(y) << 1 | expandBits(z) << 2;
+}
+
+uint64_t mortonKey(const glm::vec3 &position, const glm::vec3 &boundsMin,
+                   float cellsPerUnit) {
+  glm::vec3 cell = (position - boundsMin) * cellsPerUnit;
+  return interleaveBits(quantize(cell.x), quantize(cell.y), quantize(cell.z));
+}
+
+template <typename P>
+std::vector<size_t>
+mortonOrder(const std::vector<BasicCelestialBody<P>> &bodies) {
+  using Real = typename P::Real;
+  using Vec3 = typename P::Vec3;
+  std::vector<size_t> order(bodies.size());
+  if (bodies.empty())
+    return order;
+
+  Vec3 boundsMin(std::numeric_limits<Real>::max());
+  Vec3 boundsMax(std::numeric_limits<Real>::lowest());
+  for (const auto &body : bodies) {
+    boundsMin = glm::min(boundsMin, body.position);
+    boundsMax = glm::max(boundsMax, body.position);
+  }
+
+  Vec3 extent = boundsMax - boundsMin;
+  float size = (float)glm::max(extent.x, glm::max(extent.y, extent.z));
+  float cellsPerUnit =
+      size > 0.0f ? (float)(1u << MORTON_BITS_PER_AXIS) / size : 0.0f;
+
+  // keys only need locality, so offsets from the corner are enough in float
+  std::vector<std::pair<uint64_t, size_t>> keys(bodies.size());
+  dispatchKernel([&]() {
+    for (size_t i = 0; i < bodies.size(); i++)
+      keys[i] = {mortonKey(glm::vec3(bodies[i].position - boundsMin),
+                           glm::vec3(0.0f), cellsPerUnit),
+                 i};
+  });
+  std::sort(keys.begin(), keys.end());
+
+  for (size_t i = 0; i < keys.size(); i++)
+    order[i] = keys[i].second;
+  return order;
+}
+
+template std::vector<size_t>
+mortonOrder(const std::vector<BasicCelestialBody<FloatPrecision>> &bodies);
+template std::vector<size_t>
+mortonOrder(const std::vector<BasicCelestialBody<DoublePrecision>> &bodies);
+template std::vector<size_t>
+mortonOrder(const std::vector<BasicCelestialBody<MixedPrecision>> &bodies);
@@ -0,0 +1,172 @@
+#include "include/taskScheduler.h"
+#include "include/parallel.h"
+#include <algorithm>
+
+#define TASK_SPIN_ATTEMPTS 64
+
+static thread_local const TaskScheduler *workerScheduler = nullptr;
+static thread_local int workerSlot = 0;
+
+TaskScheduler &TaskScheduler::instance() {
+  static TaskScheduler scheduler(hardwareThreadCount());
+  return scheduler;
+}
+
+TaskScheduler::TaskScheduler(int threadCount)
+    : queuedTasks(0), stopping(false) {
+  start(threadCount);
+}
+
+TaskScheduler::~TaskScheduler() { stop(); }
+
+void TaskScheduler::setThreadCount(int count) {
+  count = std::max(1, count);
+  if (count == threadCount())
+    return;
+  stop();
+  start(count);
+}
+
+void TaskScheduler::start(int count) {
+  count = std::max(1, count);
+  stopping.store(false);
+  queues.clear();
+  for (int i = 0; i < count; i++)
+    queues.push_back(std::make_unique<WorkQueue>());
+
+  for (int slot = 1; slot < count; slot++)
+    workers.emplace_back([this, slot]() { workerLoop(slot); });
+}
+
+void TaskScheduler::stop() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping.store(true);
+  }
+  wake.notify_all();
+
+  for (auto &worker : workers)
+    worker.join();
+  workers.clear();
+}
+
+int TaskScheduler::currentSlot() const {
+  return workerScheduler == this ? workerSlot : 0;
+}
+
+void TaskScheduler::workerLoop(int slot) {
+  workerScheduler = this;
+  workerSlot = slot;
+
+  int idleSpins = 0;
+  while (!stopping.load(std::memory_order_relaxed)) {
+    Task task;
+    if (popOrSteal(slot, task)) {
+      run(task);
+      idleSpins = 0;
+      continue;
+    }
+
+    if (++idleSpins < TASK_SPIN_ATTEMPTS) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this]() {
+      return stopping.load() || queuedTasks.load() > 0;
+    });
+    idleSpins = 0;
+  }
+}
+
+void TaskScheduler::push(Task task) {
+  WorkQueue &queue = *queues[currentSlot()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  queuedTasks.fetch_add(1);
+
+  // taking the lock orders this against a worker checking the predicate
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  wake.notify_one();
+}
+
+bool TaskScheduler::popOrSteal(int slot, Task &task) {
+  WorkQueue &own = *queues[slot];
+  {
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      queuedTasks.fetch_sub(1);
+      return true;
+    }
+  }
+  return stealHalf(slot, task);
+}
+
+bool TaskScheduler::stealHalf(int thief, Task &task) {
+  int count = threadCount();
+  for (int offset = 1; offset < count; offset++) {
+    WorkQueue &victim = *queues[(thief + offset) % count];
+
+    std::vector<Task> stolen;
+    {
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      size_t available = victim.tasks.size();
+      if (available == 0)
+        continue;
+
+      size_t take = (available + 1) / 2;
+      for (size_t i = 0; i < take; i++) {
+        stolen.push_back(std::move(victim.tasks.front()));
+        victim.tasks.pop_front();
+      }
+    }
+
+    task = std::move(stolen.front());
+    queuedTasks.fetch_sub(1);
+
+    if (stolen.size() > 1) {
+      WorkQueue &own = *queues[thief];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      for (size_t i = 1; i < stolen.size(); i++)
+        own.tasks.push_back(std::move(stolen[i]));
+    }
+    return true;
+  }
+  return false;
+}
+
+void TaskScheduler::run(Task &task) {
+  task.function();
+  task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+TaskGroup::TaskGroup(TaskScheduler &scheduler)
+    : scheduler(scheduler), pending(0) {}
+
+TaskGroup::~TaskGroup() { wait(); }
+
+void TaskGroup::spawn(std::function<void()> function) {
+  if (scheduler.threadCount() <= 1) {
+    function();
+    return;
+  }
+
+  pending.fetch_add(1, std::memory_order_relaxed);
+  scheduler.push(TaskScheduler::Task{std::move(function), this});
+}
+
+void TaskGroup::wait() {
+  int slot = scheduler.currentSlot();
+  while (pending.load(std::memory_order_acquire) > 0) {
+    TaskScheduler::Task task;
+    if (scheduler.popOrSteal(slot, task))
+      scheduler.run(task);
+    else
+      std::this_thread::yield();
+  }
+}
@@ -0,0 +1,309 @@
+#include "include/transport.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef GRAVITY_WITH_MPI
+#include <mpi.h>
+#endif
+
+bool parseTransportType(const std::string &name, TransportType &type) {
+  if (name == "local")
+    type = TransportType::Local;
+  else if (name == "socket")
+    type = TransportType::Socket;
+  else if (name == "mpi")
+    type = TransportType::Mpi;
+  else
+    return false;
+  return true;
+}
+
+const char *transportTypeName(TransportType type) {
+  switch (type) {
+  case TransportType::Local:
+    return "local";
+  case TransportType::Socket:
+    return "socket";
+  case TransportType::Mpi:
+    return "mpi";
+  }
+  return "unknown";
+}
+
+bool allToAll(Transport &transport, std::vector<std::vector<char>> &outgoing,
+              std::vector<std::vector<char>> &incoming) {
+  int self = transport.rank();
+  int ranks = transport.size();
+  incoming.assign(ranks, std::vector<char>());
+  bool ok = true;
+  for (int rank = 0; rank < ranks; rank++) {
+    if (rank != self)
+      ok = transport.send(rank, outgoing[rank]) && ok;
+  }
+  incoming[self] = std::move(outgoing[self]);
+  for (int rank = 0; rank < ranks; rank++) {
+    if (rank != self)
+      ok = transport.receive(rank, incoming[rank]) && ok;
+  }
+  return ok;
+}
+
+bool allGather(Transport &transport, const std::vector<char> &message,
+               std::vector<std::vector<char>> &messages) {
+  std::vector<std::vector<char>> outgoing(transport.size(), message);
+  return allToAll(transport, outgoing, messages);
+}
+
+Mailbox::Mailbox(int sources) : queues(sources), closed(sources, false) {}
+
+void Mailbox::post(int source, std::vector<char> message) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queues[source].push_back(std::move(message));
+  }
+  posted.notify_all();
+}
+
+void Mailbox::close(int source) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed[source] = true;
+  }
+  posted.notify_all();
+}
+
+bool Mailbox::take(int source, std::vector<char> &message) {
+  std::unique_lock<std::mutex> lock(mutex);
+  posted.wait(lock,
+              [&]() { return !queues[source].empty() || closed[source]; });
+  if (queues[source].empty())
+    return false;
+  message = std::move(queues[source].front());
+  queues[source].pop_front();
+  return true;
+}
+
+LocalTransport::LocalTransport(
+    int rank, std::shared_ptr<std::vector<std::unique_ptr<Mailbox>>> boxes)
+    : ownRank(rank), mailboxes(std::move(boxes)) {}
+
+std::vector<std::unique_ptr<Transport>> LocalTransport::create(int ranks) {
+  auto boxes = std::make_shared<std::vector<std::unique_ptr<Mailbox>>>();
+  for (int rank = 0; rank < ranks; rank++)
+    boxes->push_back(std::make_unique<Mailbox>(ranks));
+
+  std::vector<std::unique_ptr<Transport>> transports;
+  for (int rank = 0; rank < ranks; rank++)
+    transports.push_back(
+        std::unique_ptr<Transport>(new LocalTransport(rank, boxes)));
+  return transports;
+}
+
+bool LocalTransport::send(int destination, const std::vector<char> &message) {
+  (*mailboxes)[destination]->post(ownRank, message);
+  return true;
+}
+
+bool LocalTransport::receive(int source, std::vector<char> &message) {
+  return (*mailboxes)[ownRank]->take(source, message);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// every message is its length as 8 bytes followed by the bytes
+static bool writeAll(int socket, const char *data, size_t size) {
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+  while (size > 0) {
+    ssize_t written = ::send(socket, data, size, flags);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+static bool readAll(int socket, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t got = ::recv(socket, data, size, 0);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return false;
+    data += got;
+    size -= got;
+  }
+  return true;
+}
+
+SocketTransport::SocketTransport(int rank, std::vector<int> sockets,
+                                 std::vector<int> children)
+    : ownRank(rank), sockets(std::move(sockets)),
+      children(std::move(children)), mailbox((int)this->sockets.size()) {
+  for (int peer = 0; peer < size(); peer++) {
+    if (peer != ownRank)
+      readers.emplace_back([this, peer]() { readFrom(peer); });
+  }
+}
+
+std::unique_ptr<Transport> SocketTransport::spawn(int ranks) {
+  // ends[a][b] is a's end of the socket between a and b
+  std::vector<std::vector<int>> ends(ranks, std::vector<int>(ranks, -1));
+  for (int a = 0; a < ranks; a++) {
+    for (int b = a + 1; b < ranks; b++) {
+      int pair[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        std::cerr << "socketpair failed: " << strerror(errno) << "\n";
+        return nullptr;
+      }
+      ends[a][b] = pair[0];
+      ends[b][a] = pair[1];
+    }
+  }
+
+  int rank = 0;
+  std::vector<int> children;
+  for (int child = 1; child < ranks; child++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      std::cerr << "fork failed: " << strerror(errno) << "\n";
+      return nullptr;
+    }
+    if (pid == 0) {
+      rank = child;
+      children.clear();
+      break;
+    }
+    children.push_back((int)pid);
+  }
+
+  for (int a = 0; a < ranks; a++) {
+    if (a == rank)
+      continue;
+    for (int b = 0; b < ranks; b++) {
+      if (ends[a][b] >= 0)
+        close(ends[a][b]);
+    }
+  }
+  return std::unique_ptr<Transport>(
+      new SocketTransport(rank, ends[rank], children));
+}
+
+SocketTransport::~SocketTransport() {
+  // wakes the readers, peers see the end of the stream after our last send
+  for (int peer = 0; peer < size(); peer++) {
+    if (peer != ownRank)
+      shutdown(sockets[peer], SHUT_RDWR);
+  }
+  for (std::thread &reader : readers)
+    reader.join();
+  for (int peer = 0; peer < size(); peer++) {
+    if (peer != ownRank)
+      close(sockets[peer]);
+  }
+  for (int pid : children) {
+    int status;
+    waitpid((pid_t)pid, &status, 0);
+  }
+}
+
+void SocketTransport::readFrom(int peer) {
+  while (true) {
+    uint64_t length;
+    if (!readAll(sockets[peer], (char *)&length, sizeof(length)))
+      break;
+    std::vector<char> message(length);
+    if (!readAll(sockets[peer], message.data(), length))
+      break;
+    mailbox.post(peer, std::move(message));
+  }
+  mailbox.close(peer);
+}
+
+bool SocketTransport::send(int destination, const std::vector<char> &message) {
+  uint64_t length = message.size();
+  return writeAll(sockets[destination], (const char *)&length,
+                  sizeof(length)) &&
+         writeAll(sockets[destination], message.data(), message.size());
+}
+
+bool SocketTransport::receive(int source, std::vector<char> &message) {
+  return mailbox.take(source, message);
+}
+
+#else
+
+std::unique_ptr<Transport> SocketTransport::spawn(int) {
+  std::cerr << "the socket transport needs a POSIX system\n";
+  return nullptr;
+}
+
+#endif
+
+#ifdef GRAVITY_WITH_MPI
+
+struct MpiTransport::Pending {
+  std::vector<char> buffer;
+  MPI_Request request;
+};
+
+MpiTransport::MpiTransport() {
+  MPI_Comm_rank(MPI_COMM_WORLD, &ownRank);
+  MPI_Comm_size(MPI_COMM_WORLD, &rankCount);
+}
+
+MpiTransport::~MpiTransport() { completeSends(true); }
+
+void MpiTransport::completeSends(bool wait) {
+  auto done = [&](std::unique_ptr<Pending> &send) {
+    int finished = 0;
+    if (wait)
+      MPI_Wait(&send->request, MPI_STATUS_IGNORE);
+    else
+      MPI_Test(&send->request, &finished, MPI_STATUS_IGNORE);
+    return wait || finished != 0;
+  };
+  pending.erase(std::remove_if(pending.begin(), pending.end(), done),
+                pending.end());
+}
+
+// the copy stays alive until the send completes, so the caller can reuse
+// its buffer at once
+bool MpiTransport::send(int destination, const std::vector<char> &message) {
+  completeSends(false);
+  auto send = std::make_unique<Pending>();
+  send->buffer = message;
+  if (MPI_Isend(send->buffer.data(), (int)send->buffer.size(), MPI_BYTE,
+                destination, 0, MPI_COMM_WORLD,
+                &send->request) != MPI_SUCCESS)
+    return false;
+  pending.push_back(std::move(send));
+  return true;
+}
+
+bool MpiTransport::receive(int source, std::vector<char> &message) {
+  MPI_Status status;
+  if (MPI_Probe(source, 0, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+    return false;
+  int count = 0;
+  MPI_Get_count(&status, MPI_BYTE, &count);
+  message.resize(count);
+  return MPI_Recv(message.data(), count, MPI_BYTE, source, 0, MPI_COMM_WORLD,
+                  MPI_STATUS_IGNORE) == MPI_SUCCESS;
+}
+
+#endif